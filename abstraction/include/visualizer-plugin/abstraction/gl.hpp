@@ -4,8 +4,21 @@
 #include<string>
 #include<string_view>
 #include<stdexcept>
+#include<algorithm>
+#include<atomic>
+#include<bit>
 #include<concepts>
+#include<cstddef>
+#include<cstring>
+#include<cstdint>
+#include<initializer_list>
+#include<map>
+#include<mutex>
 #include<ranges>
+#include<span>
+#include<unordered_map>
+#include<utility>
+#include<vector>
 
 #include "boost/pfr.hpp"
 
@@ -63,19 +76,178 @@ using bbox2 = tbox2<char>;
 using dbox2 = tbox2<double>;
 using box2 = tbox2<float>;
 
+// per-context cache of bound objects and fixed-function state.
+// setters skip calls that would not change anything and getters never
+// query the driver; code that changes tracked state with raw GL calls
+// must call invalidate() afterwards.
+struct state{
+  static constexpr unsigned unknown = -1;
+  static state& current(){
+    thread_local state s;
+    return s;
+  }
+  void use_program(unsigned h){
+    if(program != h)
+      glUseProgram(program = h);
+  }
+  void bind_vertex_array(unsigned h){
+    if(vertex_array != h)
+      glBindVertexArray(vertex_array = h);
+  }
+  void bind_framebuffer(unsigned target, unsigned h){
+    bool draw = target != GL_READ_FRAMEBUFFER;
+    bool read = target != GL_DRAW_FRAMEBUFFER;
+    if(draw && read && (draw_framebuffer != h || read_framebuffer != h))
+      glBindFramebuffer(GL_FRAMEBUFFER, draw_framebuffer = read_framebuffer = h);
+    else if(draw && !read && draw_framebuffer != h)
+      glBindFramebuffer(GL_DRAW_FRAMEBUFFER, draw_framebuffer = h);
+    else if(read && !draw && read_framebuffer != h)
+      glBindFramebuffer(GL_READ_FRAMEBUFFER, read_framebuffer = h);
+  }
+  void bind_buffer(unsigned target, unsigned h){
+    auto& bound = buffer_slot(target);
+    if(bound != h)
+      glBindBuffer(target, bound = h);
+  }
+  // also replaces the generic binding of the target, like the driver does
+  void bind_buffer_base(unsigned target, unsigned index, unsigned h){
+    glBindBufferBase(target, index, h);
+    buffer_slot(target) = h;
+  }
+  void viewport(glm::ivec4 v){
+    if(viewport_box != v){
+      viewport_box = v;
+      glViewport(v.x, v.y, v.z, v.w);
+    }
+  }
+  void depth_mask(bool b){
+    if(depth_write != (int)b){
+      depth_write = b;
+      glDepthMask(b);
+    }
+  }
+  void depth_func(unsigned f){
+    if(depth_test_func != f)
+      glDepthFunc(depth_test_func = f);
+  }
+  void cull_face(unsigned f){
+    if(cull_mode != f)
+      glCullFace(cull_mode = f);
+  }
+  void front_face(unsigned f){
+    if(winding != f)
+      glFrontFace(winding = f);
+  }
+  void blend_func(unsigned src, unsigned dst){
+    if(blend_src != src || blend_dst != dst)
+      glBlendFunc(blend_src = src, blend_dst = dst);
+  }
+  void clear_color(glm::vec4 c){
+    if(!clear_known || clear_value != c){
+      clear_known = true;
+      clear_value = c;
+      glClearColor(c.x, c.y, c.z, c.w);
+    }
+  }
+  void enable(unsigned cap, bool on = true){
+    for(auto& [c, value]:capabilities)
+      if(c == cap){
+        if(value != (int)on){
+          value = on;
+          set_capability(cap, on);
+        }
+        return;
+      }
+    capabilities.emplace_back(cap, on);
+    set_capability(cap, on);
+  }
+  void disable(unsigned cap){
+    enable(cap, false);
+  }
+  unsigned bound_program() const{
+    return program;
+  }
+  unsigned bound_vertex_array() const{
+    return vertex_array;
+  }
+  unsigned bound_framebuffer(unsigned target) const{
+    return target == GL_READ_FRAMEBUFFER ? read_framebuffer : draw_framebuffer;
+  }
+  unsigned bound_buffer(unsigned target) const{
+    for(auto& [t, h]:buffers)
+      if(t == target)
+        return h;
+    return unknown;
+  }
+  // the driver unbinds deleted objects from the current context
+  void released_program(unsigned h){
+    if(h && program == h)
+      program = 0;
+  }
+  void released_vertex_array(unsigned h){
+    if(h && vertex_array == h)
+      vertex_array = 0;
+  }
+  void released_framebuffer(unsigned h){
+    if(h && draw_framebuffer == h)
+      draw_framebuffer = 0;
+    if(h && read_framebuffer == h)
+      read_framebuffer = 0;
+  }
+  void released_buffer(unsigned h){
+    for(auto& [t, bound]:buffers)
+      if(h && bound == h)
+        bound = 0;
+  }
+  void invalidate(){
+    *this = state{};
+  }
+private:
+  unsigned& buffer_slot(unsigned target){
+    for(auto& [t, h]:buffers)
+      if(t == target)
+        return h;
+    return buffers.emplace_back(target, unknown).second;
+  }
+  static void set_capability(unsigned cap, bool on){
+    if(on)
+      glEnable(cap);
+    else
+      glDisable(cap);
+  }
+  unsigned program = unknown;
+  unsigned vertex_array = unknown;
+  unsigned draw_framebuffer = unknown;
+  unsigned read_framebuffer = unknown;
+  std::vector<std::pair<unsigned, unsigned>> buffers;
+  std::vector<std::pair<unsigned, int>> capabilities;
+  glm::ivec4 viewport_box{-1};
+  int depth_write = -1;
+  unsigned depth_test_func = unknown;
+  unsigned cull_mode = unknown;
+  unsigned winding = unknown;
+  unsigned blend_src = unknown, blend_dst = unknown;
+  glm::vec4 clear_value{};
+  bool clear_known = false;
+};
+
 template<shader_type type>
 struct shader{
   shader():handle{}{}
-  shader(shader&& other):handle(std::exchange(other.handle, 0)){}
+  shader(shader&& other):source(std::move(other.source)), handle(std::exchange(other.handle, 0)){}
   shader(const shader&) = delete;
   operator bool() const{
-    return handle;
+    return handle || !source.empty();
   }
   friend struct program;
-  shader(std::string_view text):
-    handle{glCreateShader((unsigned)type)}{
-    int size = text.size();
-    const char * data = text.data();
+  // compiled when a program needs it, a cached program binary skips that
+  shader(std::string_view text):source(text), handle{}{}
+  unsigned compile(){
+    if(handle)
+      return handle;
+    handle = glCreateShader((unsigned)type);
+    int size = source.size();
+    const char * data = source.data();
     glShaderSource(handle, 1, &data, &size);
     glCompileShader(handle);
     int ok = 0;
@@ -87,27 +259,211 @@ struct shader{
       std::string log(len, '\0');
       glGetShaderInfoLog(handle, len, &len, log.data());
       log.resize(len + 1);
-      glDeleteShader(handle);
+      glDeleteShader(std::exchange(handle, 0));
       throw std::runtime_error(log);
     }
+    return handle;
   }
   ~shader(){
     glDeleteShader(handle);
   }
 private:
+  std::string source;
   unsigned handle;
 };
 
+// bytes of gpu memory held per owner. an object is charged to the owner
+// current on the thread that allocates it, 0 being whoever did not say,
+// and refunds the same owner when it goes away
+struct memory{
+  static memory& get(){
+    static memory m;
+    return m;
+  }
+  static unsigned& current(){
+    thread_local unsigned owner = 0;
+    return owner;
+  }
+  struct scope{
+    scope(unsigned owner):previous(std::exchange(current(), owner)){}
+    ~scope(){
+      current() = previous;
+    }
+    scope(const scope&) = delete;
+    unsigned previous;
+  };
+  void charge(unsigned owner, int64_t bytes){
+    std::lock_guard lock(m);
+    usage[owner] += bytes;
+    total += bytes;
+  }
+  size_t used() const{
+    return total.load(std::memory_order_relaxed);
+  }
+  size_t used(unsigned owner){
+    std::lock_guard lock(m);
+    auto it = usage.find(owner);
+    return it == usage.end() ? 0 : it->second;
+  }
+  template<class F>
+  void each(F&& f){
+    std::lock_guard lock(m);
+    for(auto [owner, bytes]:usage)
+      f(owner, (size_t)bytes);
+  }
+private:
+  std::mutex m;
+  std::unordered_map<unsigned, int64_t> usage;
+  std::atomic<int64_t> total{0};
+};
+// the charge of one object
+struct allocation{
+  allocation() = default;
+  allocation(size_t bytes):owner(memory::current()), bytes(bytes){
+    memory::get().charge(owner, bytes);
+  }
+  allocation(allocation&& other):owner(other.owner), bytes(std::exchange(other.bytes, 0)){}
+  allocation& operator=(allocation&& other){
+    std::swap(owner, other.owner);
+    std::swap(bytes, other.bytes);
+    return *this;
+  }
+  ~allocation(){
+    if(bytes)
+      memory::get().charge(owner, -(int64_t)bytes);
+  }
+  void resize(size_t b){
+    memory::get().charge(owner, (int64_t)b - (int64_t)bytes);
+    bytes = b;
+  }
+  unsigned owner = 0;
+  size_t bytes = 0;
+};
+// storage per pixel of the formats in use, 4 for anything else
+inline size_t pixel_bytes(unsigned format){
+  switch(format){
+    case GL_R8: return 1;
+    case GL_RG8: return 2;
+    case GL_RGBA16F: case GL_RG32F: return 8;
+    case GL_RGBA32F: return 16;
+    default: return 4;
+  }
+}
+// size of one pixel in client memory for the format and type of
+// glTextureSubImage2D, 0 for combinations not listed
+inline size_t client_pixel_bytes(unsigned format, unsigned type){
+  size_t components;
+  switch(format){
+    case GL_RED: case GL_GREEN: case GL_BLUE: case GL_RED_INTEGER:
+    case GL_DEPTH_COMPONENT: case GL_STENCIL_INDEX: components = 1; break;
+    case GL_RG: case GL_RG_INTEGER: case GL_DEPTH_STENCIL: components = 2; break;
+    case GL_RGB: case GL_BGR: case GL_RGB_INTEGER: case GL_BGR_INTEGER: components = 3; break;
+    case GL_RGBA: case GL_BGRA: case GL_RGBA_INTEGER: case GL_BGRA_INTEGER: components = 4; break;
+    default: return 0;
+  }
+  switch(type){
+    case GL_UNSIGNED_BYTE: case GL_BYTE: return components;
+    case GL_UNSIGNED_SHORT: case GL_SHORT: case GL_HALF_FLOAT: return 2 * components;
+    case GL_UNSIGNED_INT: case GL_INT: case GL_FLOAT: return 4 * components;
+    // packed types hold a whole pixel
+    case GL_UNSIGNED_BYTE_3_3_2: case GL_UNSIGNED_BYTE_2_3_3_REV: return 1;
+    case GL_UNSIGNED_SHORT_5_6_5: case GL_UNSIGNED_SHORT_5_6_5_REV:
+    case GL_UNSIGNED_SHORT_4_4_4_4: case GL_UNSIGNED_SHORT_4_4_4_4_REV:
+    case GL_UNSIGNED_SHORT_5_5_5_1: case GL_UNSIGNED_SHORT_1_5_5_5_REV: return 2;
+    case GL_UNSIGNED_INT_8_8_8_8: case GL_UNSIGNED_INT_8_8_8_8_REV:
+    case GL_UNSIGNED_INT_10_10_10_2: case GL_UNSIGNED_INT_2_10_10_10_REV:
+    case GL_UNSIGNED_INT_24_8: case GL_UNSIGNED_INT_10F_11F_11F_REV:
+    case GL_UNSIGNED_INT_5_9_9_9_REV: return 4;
+    case GL_FLOAT_32_UNSIGNED_INT_24_8_REV: return 8;
+    default: return 0;
+  }
+}
+
+// linked program binaries keyed by their shader sources; shared by all
+// contexts of the process and filled whenever a program links
+struct program_cache{
+  struct binary{
+    unsigned format;
+    std::vector<char> data;
+  };
+  static program_cache& get(){
+    static program_cache c;
+    return c;
+  }
+  // fnv-1a over the stages and their sources
+  static uint64_t key(std::initializer_list<std::pair<unsigned, std::string_view>> stages){
+    uint64_t h = 14695981039346656037ull;
+    auto mix = [&](std::string_view s){
+      for(unsigned char c:s)
+        h = (h ^ c) * 1099511628211ull;
+    };
+    for(auto [type, source]:stages){
+      mix({(const char*)&type, sizeof type});
+      mix(source);
+    }
+    return h;
+  }
+  // false if there is no binary or the driver rejects it
+  bool load(unsigned program, uint64_t key){
+    std::unique_lock lock(m);
+    auto it = binaries.find(key);
+    if(it == binaries.end())
+      return false;
+    glProgramBinary(program, it->second.format, it->second.data.data(), it->second.data.size());
+    int ok = 0;
+    glGetProgramiv(program, GL_LINK_STATUS, &ok);
+    if(!ok)
+      binaries.erase(it);
+    return ok;
+  }
+  void store(unsigned program, uint64_t key){
+    int size = 0;
+    glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &size);
+    if(!size)
+      return;
+    binary b{0, std::vector<char>(size)};
+    glGetProgramBinary(program, size, &size, &b.format, b.data.data());
+    b.data.resize(size);
+    std::lock_guard lock(m);
+    binaries.insert_or_assign(key, std::move(b));
+  }
+  void insert(uint64_t key, unsigned format, std::span<const char> data){
+    std::lock_guard lock(m);
+    binaries.insert_or_assign(key, binary{format, {data.begin(), data.end()}});
+  }
+  template<class F>
+  void each(F&& f){
+    std::lock_guard lock(m);
+    for(auto& [key, b]:binaries)
+      f(key, b.format, std::span<const char>(b.data));
+  }
+private:
+  std::mutex m;
+  std::unordered_map<uint64_t, binary> binaries;
+};
+
 struct program{
   program():handle{}{}
-  program(program&& other):handle(std::exchange(other.handle, 0)){}
+  program(program&& other):handle(std::exchange(other.handle, 0)), charged(std::move(other.charged)){}
   program(const program&) = delete;
+  program& operator=(program&& other){
+    handle = std::exchange(other.handle, handle);
+    charged = std::move(other.charged);
+    return *this;
+  }
   operator bool() const{
     return handle;
   }
   template<auto... type>
   program(shader<type>&&... shaders):handle{glCreateProgram()}{
-    (glAttachShader(handle, shaders.handle), ...);
+    auto& cache = program_cache::get();
+    auto key = program_cache::key({{(unsigned)type, shaders.source}...});
+    if(cache.load(handle, key)){
+      charge();
+      return;
+    }
+    (glAttachShader(handle, shaders.compile()), ...);
+    glProgramParameteri(handle, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
     glLinkProgram(handle);
     int ok = 0;
     glGetProgramiv(handle, GL_LINK_STATUS, &ok);
@@ -120,6 +476,8 @@ struct program{
       glDeleteProgram(handle);
       throw std::runtime_error(log);
     }
+    cache.store(handle, key);
+    charge();
   }
   auto attrib_loc(const char * name){
     return glGetAttribLocation(handle, name);
@@ -128,10 +486,24 @@ struct program{
     return glGetUniformLocation(handle, name);
   }
   void bind(){
-    glUseProgram(handle);
+    state::current().use_program(handle);
+  }
+  ~program(){
+    state::current().released_program(handle);
+    glDeleteProgram(handle);
+  }
+  auto native() const{
+    return handle;
   }
 private:
+  // the binary stands in for what the driver keeps of a program
+  void charge(){
+    int size = 0;
+    glGetProgramiv(handle, GL_PROGRAM_BINARY_LENGTH, &size);
+    charged = allocation(size);
+  }
   unsigned handle;
+  allocation charged;
 };
 
 enum class bind_point{
@@ -158,7 +530,9 @@ struct buffer{
   buffer(buffer&& other):
     handle(std::exchange(other.handle, {})),
     buffer_size(std::exchange(other.buffer_size, {})),
-    mapped_address(std::exchange(other.mapped_address, {}))
+    mapped_address(std::exchange(other.mapped_address, {})),
+    storage_flags(std::exchange(other.storage_flags, {})),
+    charged(std::move(other.charged))
   {}
   buffer(const buffer& other) = delete;
   buffer& operator=(const buffer& other) = delete;
@@ -166,15 +540,28 @@ struct buffer{
     handle = std::exchange(other.handle, handle);
     buffer_size = std::exchange(other.buffer_size, buffer_size);
     mapped_address = std::exchange(other.mapped_address, mapped_address);
+    storage_flags = std::exchange(other.storage_flags, storage_flags);
+    charged = std::move(other.charged);
     return *this;
   }
   operator bool() const{
     return handle;
   }
-  buffer(std::initializer_list<T> list):handle{genbuffer()}, buffer_size{list.size()}{
+  buffer(std::initializer_list<T> list):handle{genbuffer()}, buffer_size{list.size()}, charged{list.size() * sizeof(T)}{
     glNamedBufferData(handle, list.size() * sizeof(T), (void*)std::data(list), GL_STATIC_DRAW);
   }
+  // immutable storage, flags as for glBufferStorage
+  buffer(size_t count, unsigned flags, const T* data = nullptr):
+    handle{genbuffer()},
+    buffer_size{count},
+    storage_flags{flags | immutable},
+    charged{count * sizeof(T)}{
+    glNamedBufferStorage(handle, count * sizeof(T), data, flags);
+  }
+  buffer(std::span<const T> data, unsigned flags = GL_DYNAMIC_STORAGE_BIT):
+    buffer(data.size(), flags, data.data()){}
   ~buffer(){
+    state::current().released_buffer(handle);
     glDeleteBuffers(1, &handle);
   }
   T* map(int access){
@@ -188,24 +575,52 @@ struct buffer{
     mapped_address = nullptr;
   }
   void bind(bind_point p){
-    glBindBuffer((int)p, handle);
+    state::current().bind_buffer((unsigned)p, handle);
   }
   void bind(bind_point p, int index){
     if(p == bind_point::array)
       glBindVertexBuffer(index, handle, 0, sizeof(T));
-    glBindBufferBase((int)p, index, handle);
+    state::current().bind_buffer_base((unsigned)p, index, handle);
   }
   size_t size(){
     return buffer_size;
   }
+  auto native() const{
+    return handle;
+  }
   void resize(size_t s){
     glNamedBufferData(handle, s * sizeof(T), nullptr, GL_STATIC_DRAW);
     buffer_size = s;
+    charged.resize(s * sizeof(T));
+  }
+  void write(size_t offset, std::span<const T> data){
+    glNamedBufferSubData(handle, offset * sizeof(T), data.size_bytes(), data.data());
+  }
+  // keeps the contents; grows by at least half the current size so that
+  // repeated appends cost amortized constant copies.
+  // the buffer gets a new name, vertex arrays have to be rebuilt
+  void grow(size_t s){
+    if(s <= buffer_size)
+      return;
+    s = std::max(s, buffer_size + buffer_size / 2);
+    buffer next = storage_flags & immutable
+      ? buffer(s, storage_flags & ~immutable)
+      : buffer(s);
+    if(handle && buffer_size)
+      glCopyNamedBufferSubData(handle, next.handle, 0, 0, buffer_size * sizeof(T));
+    unmap();
+    *this = std::move(next);
   }
 private:
+  static constexpr unsigned immutable = 1u << 31;
+  explicit buffer(size_t count):handle{genbuffer()}, buffer_size{count}, charged{count * sizeof(T)}{
+    glNamedBufferData(handle, count * sizeof(T), nullptr, GL_STATIC_DRAW);
+  }
   unsigned handle;
   size_t buffer_size = 0;
   T* mapped_address = nullptr;
+  unsigned storage_flags = 0;
+  allocation charged;
   static auto genbuffer(){
     unsigned h;
     glCreateBuffers(1,&h);
@@ -215,6 +630,262 @@ private:
 template<class T>
 buffer(std::initializer_list<T>)->buffer<T>;
 
+// one large buffer handing out aligned byte ranges, so that many small
+// meshes share a single GL object. freed ranges are coalesced; when no
+// free range fits, storage grows geometrically and keeps its contents
+struct arena{
+  struct range{
+    size_t offset = 0;
+    size_t size = 0;
+    explicit operator bool() const{
+      return size;
+    }
+  };
+  arena() = default;
+  arena(size_t bytes, size_t alignment = 256):
+    storage(bytes, GL_DYNAMIC_STORAGE_BIT),
+    alignment(alignment){
+    free_ranges.emplace(0, bytes);
+  }
+  range allocate(size_t bytes){
+    bytes = (bytes + alignment - 1) / alignment * alignment;
+    for(;;){
+      for(auto it = free_ranges.begin(); it != free_ranges.end(); ++it){
+        auto [offset, size] = *it;
+        if(size < bytes)
+          continue;
+        free_ranges.erase(it);
+        if(size > bytes)
+          free_ranges.emplace(offset + bytes, size - bytes);
+        used += bytes;
+        return {offset, bytes};
+      }
+      auto old_size = storage.size();
+      storage.grow(old_size + bytes);
+      release({old_size, storage.size() - old_size});
+      ++storage_generation;
+    }
+  }
+  void free(range r){
+    if(!r)
+      return;
+    used -= r.size;
+    release(r);
+  }
+  void write(range r, const void* data, size_t bytes, size_t offset = 0){
+    glNamedBufferSubData(storage.native(), r.offset + offset, bytes, data);
+  }
+  unsigned native() const{
+    return storage.native();
+  }
+  size_t capacity(){
+    return storage.size();
+  }
+  size_t allocated() const{
+    return used;
+  }
+  // changes whenever growth moved the storage to a new buffer name
+  unsigned generation() const{
+    return storage_generation;
+  }
+private:
+  void release(range r){
+    auto next = free_ranges.lower_bound(r.offset);
+    if(next != free_ranges.end() && r.offset + r.size == next->first){
+      r.size += next->second;
+      next = free_ranges.erase(next);
+    }
+    if(next != free_ranges.begin()){
+      auto prev = std::prev(next);
+      if(prev->first + prev->second == r.offset){
+        prev->second += r.size;
+        return;
+      }
+    }
+    free_ranges.emplace(r.offset, r.size);
+  }
+  buffer<std::byte> storage;
+  std::map<size_t, size_t> free_ranges;
+  size_t alignment = 256;
+  size_t used = 0;
+  unsigned storage_generation = 0;
+};
+
+// persistently mapped staging memory for per-frame uploads. the ring is
+// split into one segment per frame in flight; a segment is reused only
+// after the GPU passed the fence placed when its frame ended
+struct stream_ring{
+  stream_ring() = default;
+  stream_ring(size_t bytes, unsigned segments = 3):
+    storage(bytes, flags),
+    segment_size(bytes / segments),
+    fences(segments, nullptr){
+    base = (std::byte*)glMapNamedBufferRange(storage.native(), 0, bytes, flags);
+  }
+  stream_ring(stream_ring&& other):
+    storage(std::move(other.storage)),
+    base(std::exchange(other.base, nullptr)),
+    segment_size(other.segment_size),
+    segment(other.segment),
+    cursor(other.cursor),
+    fences(std::move(other.fences))
+  {}
+  stream_ring& operator=(stream_ring&& other){
+    storage = std::move(other.storage);
+    base = std::exchange(other.base, base);
+    segment_size = std::exchange(other.segment_size, segment_size);
+    segment = std::exchange(other.segment, segment);
+    cursor = std::exchange(other.cursor, cursor);
+    fences.swap(other.fences);
+    return *this;
+  }
+  ~stream_ring(){
+    for(auto f:fences)
+      if(f)
+        glDeleteSync(f);
+    if(base)
+      glUnmapNamedBuffer(storage.native());
+  }
+  // copies bytes from data into dst at dst_offset through the ring, or
+  // directly when the current segment is full
+  void upload(unsigned dst, size_t dst_offset, const void* data, size_t bytes){
+    auto offset = (cursor + 15) / 16 * 16;
+    if(!base || offset + bytes > segment_size){
+      glNamedBufferSubData(dst, dst_offset, bytes, data);
+      return;
+    }
+    auto src = segment * segment_size + offset;
+    std::memcpy(base + src, data, bytes);
+    glCopyNamedBufferSubData(storage.native(), dst, src, dst_offset, bytes);
+    cursor = offset + bytes;
+  }
+  void end_frame(){
+    if(!base)
+      return;
+    fences[segment] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    segment = (segment + 1) % fences.size();
+    cursor = 0;
+    if(auto f = std::exchange(fences[segment], nullptr)){
+      while(glClientWaitSync(f, GL_SYNC_FLUSH_COMMANDS_BIT, 1'000'000) == GL_TIMEOUT_EXPIRED);
+      glDeleteSync(f);
+    }
+  }
+private:
+  static constexpr unsigned flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+  buffer<std::byte> storage;
+  std::byte* base = nullptr;
+  size_t segment_size = 0;
+  size_t segment = 0;
+  size_t cursor = 0;
+  std::vector<GLsync> fences;
+};
+
+// immutable 2d storage; sampled with texelFetch or bound as an image, so
+// filtering is nearest and coordinates clamp
+struct texture{
+  texture():handle{}{}
+  texture(const texture& other) = delete;
+  texture(texture&& other):
+    handle(std::exchange(other.handle, 0)),
+    texture_size(std::exchange(other.texture_size, {})),
+    texture_format(other.texture_format),
+    texture_levels(other.texture_levels),
+    charged(std::move(other.charged))
+  {}
+  texture& operator=(const texture& other) = delete;
+  texture& operator=(texture&& other){
+    handle = std::exchange(other.handle, handle);
+    texture_size = std::exchange(other.texture_size, texture_size);
+    texture_format = std::exchange(other.texture_format, texture_format);
+    texture_levels = std::exchange(other.texture_levels, texture_levels);
+    charged = std::move(other.charged);
+    return *this;
+  }
+  ~texture(){
+    glDeleteTextures(1, &handle);
+  }
+  operator bool() const{
+    return handle;
+  }
+  texture(glm::uvec2 size, unsigned format, int levels = 1):
+    handle{gentexture()},
+    texture_size{size},
+    texture_format{format},
+    texture_levels{levels}{
+    glTextureStorage2D(handle, levels, format, size.x, size.y);
+    size_t bytes = 0;
+    for(int level = 0; level < levels; ++level)
+      bytes += (size_t)this->size(level).x * this->size(level).y * pixel_bytes(format);
+    charged = allocation(bytes);
+    glTextureParameteri(handle, GL_TEXTURE_MIN_FILTER, levels > 1 ? GL_NEAREST_MIPMAP_NEAREST : GL_NEAREST);
+    glTextureParameteri(handle, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTextureParameteri(handle, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTextureParameteri(handle, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  }
+  // levels down to 1x1
+  static int full_chain(glm::uvec2 size){
+    return std::bit_width(std::max({size.x, size.y, 1u}));
+  }
+  void filter(unsigned min, unsigned mag){
+    glTextureParameteri(handle, GL_TEXTURE_MIN_FILTER, min);
+    glTextureParameteri(handle, GL_TEXTURE_MAG_FILTER, mag);
+  }
+  // pixels of region, rows tightly packed with the unpack alignment
+  void write(int level, ubox2 region, unsigned format, unsigned type, const void* pixels){
+    auto size = region.max - region.min;
+    glTextureSubImage2D(handle, level, region.min.x, region.min.y, size.x, size.y, format, type, pixels);
+  }
+  // the same from offset bytes into an unpack buffer
+  template<class T>
+  void write(int level, ubox2 region, unsigned format, unsigned type, buffer<T>& unpack, size_t offset){
+    auto& gl_state = state::current();
+    auto prev_buf = gl_state.bound_buffer((unsigned)bind_point::pixel_unpack);
+    unpack.bind(bind_point::pixel_unpack);
+    write(level, region, format, type, (const void*)offset);
+    gl_state.bind_buffer((unsigned)bind_point::pixel_unpack, prev_buf == state::unknown ? 0 : prev_buf);
+  }
+  void copy(const texture& src, int level, ubox2 region){
+    auto size = region.max - region.min;
+    glCopyImageSubData(
+      src.handle, GL_TEXTURE_2D, level, region.min.x, region.min.y, 0,
+      handle, GL_TEXTURE_2D, level, region.min.x, region.min.y, 0,
+      size.x, size.y, 1
+    );
+  }
+  void generate_mipmaps(){
+    glGenerateTextureMipmap(handle);
+  }
+  void bind(unsigned unit){
+    glBindTextureUnit(unit, handle);
+  }
+  void bind_image(unsigned unit, int level, unsigned access){
+    glBindImageTexture(unit, handle, level, GL_FALSE, 0, access, texture_format);
+  }
+  glm::uvec2 size(int level = 0) const{
+    return {std::max(texture_size.x >> level, 1u), std::max(texture_size.y >> level, 1u)};
+  }
+  int levels() const{
+    return texture_levels;
+  }
+  unsigned format() const{
+    return texture_format;
+  }
+  unsigned native() const{
+    return handle;
+  }
+private:
+  static unsigned gentexture(){
+    unsigned h;
+    glCreateTextures(GL_TEXTURE_2D, 1, &h);
+    return h;
+  }
+  unsigned handle;
+  glm::uvec2 texture_size{};
+  unsigned texture_format = 0;
+  int texture_levels = 0;
+  allocation charged;
+};
+
 struct renderbuffer{
   renderbuffer():handle{}, buffer_size{}{}
   renderbuffer(const renderbuffer& other) = delete;
@@ -222,7 +893,8 @@ struct renderbuffer{
     handle(std::exchange(other.handle, 0)),
     buffer_size(std::exchange(other.buffer_size, {})),
     buffer_format(std::exchange(other.buffer_format, buffer_format)),
-    buffer_samples(std::exchange(other.buffer_samples, buffer_samples))
+    buffer_samples(std::exchange(other.buffer_samples, buffer_samples)),
+    charged(std::move(other.charged))
   {}
   renderbuffer& operator=(const renderbuffer& other) = delete;
   renderbuffer& operator=(renderbuffer&& other){
@@ -230,8 +902,12 @@ struct renderbuffer{
     buffer_size = std::exchange(other.buffer_size, buffer_size);
     buffer_format = std::exchange(other.buffer_format, buffer_format);
     buffer_samples = std::exchange(other.buffer_samples, buffer_samples);
+    charged = std::move(other.charged);
     return *this;
   }
+  ~renderbuffer(){
+    glDeleteRenderbuffers(1, &handle);
+  }
   operator bool() const{
     return handle;
   }
@@ -239,7 +915,8 @@ struct renderbuffer{
     handle{genbuffer()},
     buffer_size{size},
     buffer_format{format},
-    buffer_samples{samples}{
+    buffer_samples{samples},
+    charged{bytes(size)}{
     glNamedRenderbufferStorageMultisample(handle, samples, format, size.x, size.y);
   }
   glm::uvec2 size() const{
@@ -248,6 +925,13 @@ struct renderbuffer{
   void resize(glm::uvec2 size){
     glNamedRenderbufferStorageMultisample(handle, buffer_samples, buffer_format, size.x, size.y);
     buffer_size = size;
+    charged.resize(bytes(size));
+  }
+  int samples() const{
+    return buffer_samples;
+  }
+  unsigned native() const{
+    return handle;
   }
 private:
   friend struct framebuffer;
@@ -256,40 +940,71 @@ private:
     glCreateRenderbuffers(1,&h);
     return h;
   }
+  size_t bytes(glm::uvec2 size) const{
+    return (size_t)size.x * size.y * pixel_bytes(buffer_format) * std::max(buffer_samples, 1);
+  }
   unsigned handle;
   glm::uvec2 buffer_size;
   int buffer_format;
   int buffer_samples;
+  allocation charged;
 };
+// framebuffer objects are not shared between contexts either, so the
+// attachments are recorded and the object is created by the first context
+// that uses it
 struct framebuffer{
-  framebuffer():handle{genbuffer()}{}
+  framebuffer(){}
   framebuffer(const framebuffer& other) = delete;
   framebuffer(framebuffer&& other):
-    handle(std::exchange(other.handle, 0))
+    read_attachment(std::exchange(other.read_attachment, GL_COLOR_ATTACHMENT0)),
+    handle(std::exchange(other.handle, 0)),
+    attachments(std::move(other.attachments)),
+    draw_buffers(std::move(other.draw_buffers)),
+    configured(std::exchange(other.configured, false))
   {}
   framebuffer& operator=(const framebuffer& other) = delete;
   framebuffer& operator=(framebuffer&& other){
     handle = std::exchange(other.handle, handle);
+    read_attachment = std::exchange(other.read_attachment, read_attachment);
+    attachments.swap(other.attachments);
+    draw_buffers.swap(other.draw_buffers);
+    configured = std::exchange(other.configured, configured);
     return *this;
   }
+  ~framebuffer(){
+    if(!handle)
+      return;
+    state::current().released_framebuffer(handle);
+    glDeleteFramebuffers(1, &handle);
+  }
   operator bool() const{
-    return handle;
+    return configured;
   }
   void attach(renderbuffer& b, int attachment){
-    glNamedFramebufferRenderbuffer(handle, attachment, GL_RENDERBUFFER, b.handle);
+    std::erase_if(attachments, [&](auto& a){ return a.first == attachment; });
+    attachments.push_back({attachment, b.handle});
+    if(handle)
+      glNamedFramebufferRenderbuffer(handle, attachment, GL_RENDERBUFFER, b.handle);
   }
   void bind(bool draw, bool read){
-    int attachment[]{0, GL_READ_FRAMEBUFFER, GL_DRAW_FRAMEBUFFER, GL_FRAMEBUFFER};
-    glBindFramebuffer(attachment[draw*2+read], handle);
+    unsigned attachment[]{0, GL_READ_FRAMEBUFFER, GL_DRAW_FRAMEBUFFER, GL_FRAMEBUFFER};
+    state::current().bind_framebuffer(attachment[draw*2+read], native());
   }
   void draw_on(std::initializer_list<unsigned> attachments){
-    glNamedFramebufferDrawBuffers(handle, attachments.size(), data(attachments));
+    draw_buffers.assign(attachments);
+    if(handle)
+      glNamedFramebufferDrawBuffers(handle, draw_buffers.size(), draw_buffers.data());
   }
   void read_on(unsigned attachment){
-    glNamedFramebufferReadBuffer(handle, attachment);
+    if(read_attachment == attachment)
+      return;
     read_attachment = attachment;
+    if(handle)
+      glNamedFramebufferReadBuffer(handle, attachment);
   }
-  auto native()const{
+  unsigned native()const{
+    if(!handle && configured)
+      create();
     return handle;
   }
   friend void blit(
@@ -297,7 +1012,8 @@ struct framebuffer{
     ubox2 dst_size,
     framebuffer& src,
     ubox2 src_size,
-    bool enable_depth){
+    bool enable_depth,
+    unsigned filter = GL_NEAREST){
     //GLint preserve_draw_fb = 0, preserve_read_fb = 0;
     //glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &preserve_draw_fb);
     //glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &preserve_read_fb);
@@ -323,7 +1039,7 @@ struct framebuffer{
       dst_size.max.x,
       dst_size.max.y,
       GL_COLOR_BUFFER_BIT | (enable_depth ? GL_DEPTH_BUFFER_BIT : 0),
-      GL_NEAREST
+      filter
     );
     
     //glReadBuffer(preserve_read);
@@ -331,11 +1047,12 @@ struct framebuffer{
     //glBindFramebuffer(GL_DRAW_FRAMEBUFFER, preserve_draw_fb);
     //glBindFramebuffer(GL_READ_FRAMEBUFFER, preserve_read_fb);
   }
+  // into buf starting offset elements in
   template<class buffer_type>
-  auto read_pixels(buffer<buffer_type>& buf, ubox2 size, int attachment, int format){
-    int prev_buf, prev_fbo;
-    glGetIntegerv(GL_PIXEL_PACK_BUFFER_BINDING, &prev_buf);
-    glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &prev_fbo);
+  auto read_pixels(buffer<buffer_type>& buf, ubox2 size, int attachment, int format, size_t offset = 0){
+    auto& gl_state = state::current();
+    auto prev_buf = gl_state.bound_buffer((unsigned)bind_point::pixel_pack);
+    auto prev_fbo = gl_state.bound_framebuffer(GL_READ_FRAMEBUFFER);
     auto prev_attachment = read_attachment;
     read_on(attachment);
     bind(0,1);
@@ -348,68 +1065,127 @@ struct framebuffer{
         format,
         //GL_BYTE,
         detail::gl_type_id<detail::component_type<buffer_type>>,
-        0);
+        (void*)(offset * sizeof(buffer_type)));
     read_on(prev_attachment);
-    glBindBuffer((int)bind_point::pixel_pack, prev_buf);
-    glBindFramebuffer(GL_READ_FRAMEBUFFER, prev_fbo);
+    if(prev_buf != state::unknown)
+      gl_state.bind_buffer((unsigned)bind_point::pixel_pack, prev_buf);
+    if(prev_fbo != state::unknown)
+      gl_state.bind_framebuffer(GL_READ_FRAMEBUFFER, prev_fbo);
   }
   static unsigned genbuffer(){
     unsigned h;
     glCreateFramebuffers(1,&h);
     return h;
   }
-  unsigned read_attachment;
-  unsigned handle;
+  unsigned read_attachment = GL_COLOR_ATTACHMENT0;
+private:
+  void create() const{
+    handle = genbuffer();
+    for(auto [attachment, h]:attachments)
+      glNamedFramebufferRenderbuffer(handle, attachment, GL_RENDERBUFFER, h);
+    if(!draw_buffers.empty())
+      glNamedFramebufferDrawBuffers(handle, draw_buffers.size(), draw_buffers.data());
+    glNamedFramebufferReadBuffer(handle, read_attachment);
+  }
+  mutable unsigned handle = 0;
+  std::vector<std::pair<int, unsigned>> attachments;
+  std::vector<unsigned> draw_buffers;
+  bool configured = true;
 };
 
 
+// vertex array objects are not shared between contexts, so the layout is
+// recorded on construction and the object is created by the first context
+// that binds it
 struct vertex_array{
-  vertex_array():handle{}{}
-  vertex_array(vertex_array&& other):handle(std::exchange(other.handle, 0)){}
+  vertex_array(){}
+  vertex_array(vertex_array&& other):
+    handle(std::exchange(other.handle, 0)),
+    layout(std::move(other.layout)),
+    element_buffer(std::exchange(other.element_buffer, 0)),
+    configured(std::exchange(other.configured, false))
+  {}
   vertex_array(const vertex_array& other) = delete;
   vertex_array& operator=(const vertex_array& other) = delete;
   vertex_array& operator=(vertex_array&& other){
     handle = std::exchange(other.handle, handle);
+    layout.swap(other.layout);
+    element_buffer = std::exchange(other.element_buffer, element_buffer);
+    configured = std::exchange(other.configured, configured);
     return *this;
   }
   operator bool() const{
-    return handle;
+    return configured;
   }
   template<class... Ts>
-  vertex_array(program& p, const buffer<Ts>&... bufs):handle(genarray()){
+  vertex_array(program& p, const buffer<Ts>&... bufs):configured(true){
     static_assert(((int)std::integral<Ts> + ... + 0) <= 1);
     auto process_buffer = [&, buffer_id=0]<class T>(const buffer<T>& buf){
       using namespace boost::pfr;
       if constexpr(std::is_aggregate_v<T>){
         [&]<size_t... i>(std::index_sequence<i...>){
-          auto current_size = 0;
+          size_t offset = 0;
           ([&]{
             using type = tuple_element_t<i, T>;
             constexpr std::string_view name_ = get_name<i, T>();
             const std::string name{name_};
            
-            current_size = ((current_size - 1) / alignof(type) + 1) * alignof(type);
+            offset = (offset + alignof(type) - 1) / alignof(type) * alignof(type);
+            auto field_offset = offset;
+            offset += sizeof(type);
             auto loc = p.attrib_loc(name.c_str());
             if(loc == -1) return;
-            glEnableVertexArrayAttrib(handle,loc);
-            glVertexArrayVertexBuffer(handle, loc, buf.handle, current_size, sizeof(T));
-            glVertexArrayAttribFormat(handle, loc, detail::component_count<type>, detail::gl_type_id<detail::component_type<type>>, GL_FALSE, current_size);
+            layout.push_back({
+              loc,
+              buf.handle,
+              (unsigned)field_offset,
+              sizeof(T),
+              detail::component_count<type>,
+              detail::gl_type_id<detail::component_type<type>>
+            });
           }(), ...);
         }(std::make_index_sequence<tuple_size_v<T>>{});
       }else if constexpr(std::integral<T>){
-        glVertexArrayElementBuffer(handle, buf.handle);
+        element_buffer = buf.handle;
       }
     };
     (process_buffer(bufs),...);
   }
   void bind(){
-    glBindVertexArray(handle);
+    state::current().bind_vertex_array(native());
+  }
+  unsigned native() const{
+    if(!handle && configured)
+      create();
+    return handle;
   }
   ~vertex_array(){
+    state::current().released_vertex_array(handle);
     glDeleteVertexArrays(1, &handle);
   }
 private:
-  unsigned handle;
+  struct attribute{
+    int loc;
+    unsigned buffer;
+    unsigned offset;
+    unsigned stride;
+    int components;
+    unsigned type;
+  };
+  mutable unsigned handle = 0;
+  std::vector<attribute> layout;
+  unsigned element_buffer = 0;
+  bool configured = false;
+  void create() const{
+    handle = genarray();
+    for(auto& a:layout){
+      glEnableVertexArrayAttrib(handle, a.loc);
+      glVertexArrayVertexBuffer(handle, a.loc, a.buffer, 0, a.stride);
+      glVertexArrayAttribFormat(handle, a.loc, a.components, a.type, GL_FALSE, a.offset);
+    }
+    if(element_buffer)
+      glVertexArrayElementBuffer(handle, element_buffer);
+  }
   static unsigned genarray(){
     unsigned h;
     glCreateVertexArrays(1,&h);
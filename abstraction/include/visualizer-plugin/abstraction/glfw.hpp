@@ -2,6 +2,7 @@
 #include "GLFW/glfw3.h"
 #include <string>
 #include <glm/glm.hpp>
+#include <concepts>
 #include <tuple>
 #include <utility>
 #include <stdexcept>
@@ -54,6 +55,10 @@ namespace detail{
     auto operator()(){}
     std::string title;
   };
+  struct shared_context{
+    auto operator()(){}
+    GLFWwindow* w;
+  };
 }
 template<class... Acts>
 struct window_builder{
@@ -66,7 +71,12 @@ struct window_builder{
         return std::get<detail::screen_size>(acts).title.c_str();
       else return "";
     }();
-    auto w = glfwCreateWindow(size.x, size.y, window_title, 0, 0);
+    auto share = [&]->GLFWwindow*{
+      if constexpr ((std::same_as<Acts, detail::shared_context> || ... || false))
+        return std::get<detail::shared_context>(acts).w;
+      else return nullptr;
+    }();
+    auto w = glfwCreateWindow(size.x, size.y, window_title, 0, share);
     
     const char* error;
     if(glfwGetError(&error))
@@ -97,6 +107,9 @@ struct window_builder{
   auto title(std::string s){
     return add(detail::window_title{std::move(s)});
   }
+  auto share(const window& other){
+    return add(detail::shared_context{other.w});
+  }
 private:
   std::tuple<Acts...> acts;
 public:
@@ -1,11 +1,34 @@
 #pragma once
 #include <glm/glm.hpp>
+#include <array>
 #include <concepts>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
 #include <functional>
+#include <memory>
+#include <ranges>
+#include <span>
+#include <stdexcept>
+#include <string>
 #include <string_view>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <boost/pfr.hpp>
 
 namespace plugin{
 
+enum class projection{
+  perspective,
+  orthographic
+};
+
+namespace impl{
+struct camera_access;
+}
+
 struct renderer_context{
   glm::uvec2 resolution() const;
   glm::vec3 position() const;
@@ -15,19 +38,335 @@ struct renderer_context{
 private:
   struct pimpl;
   friend struct render_core;
+  friend struct impl::camera_access;
   renderer_context(pimpl& x):impl(x){}
   pimpl& impl;
 };
 
+enum class render_pass:uint8_t{
+  opaque,
+  transparent
+};
+
+// one draw call; the core sorts items by (pass, program, vao, texture) and
+// only rebinds state that differs from the previous item.
+// prepare() runs right before the draw with the item's state bound.
+// an item with count == 0 only runs prepare(), which then issues its own draws.
+struct draw_item{
+  render_pass pass = render_pass::opaque;
+  unsigned program = 0;
+  unsigned vao = 0;
+  unsigned texture = 0;
+  unsigned mode = 0;
+  int first = 0;
+  int count = 0;
+  unsigned index_type = 0;
+  int instances = 1;
+  void (*prepare)(void*, const renderer_context) = nullptr;
+  void* user = nullptr;
+  // set by the core to the renderer that pushed the item, gpu memory
+  // allocated in prepare() is charged to it
+  unsigned owner = 0;
+};
+
+// an opaque indexed draw the core culls on the gpu, against the view
+// frustum and against the depth of the previous frame while the camera
+// rests; an object uncovered by an occluder moving meanwhile appears a
+// frame late. visible objects sharing (program, vao, mode) are drawn by one
+// indirect call with GL_UNSIGNED_INT indices; prepare() of the first object
+// of such a batch runs before it. shaders can tell objects apart by
+// gl_BaseInstance.
+struct gpu_object{
+  unsigned program = 0;
+  unsigned vao = 0;
+  unsigned mode = 0;
+  glm::vec3 center{};
+  float radius = 0;
+  unsigned count = 0;
+  unsigned first_index = 0;
+  int base_vertex = 0;
+  unsigned base_instance = 0;
+  unsigned instances = 1;
+  void (*prepare)(void*, const renderer_context) = nullptr;
+  void* user = nullptr;
+};
+
+struct render_queue{
+  void push(const draw_item& x){
+    items.push_back(x);
+    sorted = false;
+  }
+  void push_object(const gpu_object& x){
+    objects.push_back(x);
+    objects_changed = true;
+  }
+private:
+  friend struct render_core;
+  std::vector<draw_item> items;
+  bool sorted = true;
+  std::vector<gpu_object> objects;
+  bool objects_changed = false;
+};
+
+// an image the loader thread uploads through pixel unpack buffers. the
+// texture renderers get only changes once a batch of writes has completely
+// arrived on the gpu, so a frame never shows a partial upload. formats and
+// types are those of glTextureSubImage2D.
+struct streamed_texture{
+  streamed_texture(glm::uvec2 size, unsigned internal_format, int levels = 1);
+  streamed_texture(streamed_texture&&) = default;
+  streamed_texture& operator=(streamed_texture&&) = default;
+  // may be called from any thread; the pixels are copied before it returns.
+  // throws if the region is not inside the image or the pixels, tightly
+  // packed rows of format and type, do not cover it
+  void write(glm::uvec2 offset, glm::uvec2 size, unsigned format, unsigned type, std::span<const std::byte> pixels);
+  // fill gets the upload memory of the write on the loader thread, e.g. to
+  // decode into it
+  void write(
+    glm::uvec2 offset,
+    glm::uvec2 size,
+    unsigned format,
+    unsigned type,
+    size_t bytes,
+    std::function<void(std::span<std::byte>)> fill
+  );
+  // render thread only: the texture to bind this frame, 0 until the first
+  // write arrived
+  unsigned native() const;
+  glm::uvec2 size() const;
+  struct state;
+private:
+  std::shared_ptr<state> s;
+};
+
 struct renderer_base{
-  virtual void render(const renderer_context c) = 0;
+  // runs every frame for each view before anything is drawn, concurrently
+  // with the update of other renderers and without a GL context; meant for
+  // preparing what render() or the submitted items then only upload and draw.
+  // if it throws, the items of the renderer are skipped for that view
+  virtual void update(const renderer_context&){}
+  virtual void render(const renderer_context){}
   virtual bool is_transparent() const = 0;
+  // called once when the renderer joins the scene; the default keeps the
+  // renderer on the render() path
+  virtual void submit(render_queue& q){
+    q.push({
+      .pass = is_transparent() ? render_pass::transparent : render_pass::opaque,
+      .prepare = [](void* self, const renderer_context c){
+        static_cast<renderer_base*>(self)->render(c);
+      },
+      .user = this
+    });
+  }
+  // called on the render thread while the process is over its gpu memory
+  // budget and the core has nothing left to free, largest users first and
+  // at most about once a second; may free about bytes of what the renderer
+  // can do without, like its finest level of detail
+  virtual void release_memory(size_t){}
+  // called the same way once memory is well below the budget again; may
+  // take back up to bytes of what release_memory gave up
+  virtual void restore_memory(size_t){}
   virtual ~renderer_base() = default;
 };
 namespace impl{
   void add(const std::function<renderer_base*()>&);
+  
+  template<class T>
+  constexpr std::string_view type_name(){
+    std::string_view name = __PRETTY_FUNCTION__;
+    name.remove_prefix(name.find("T = ") + 4);
+    return name.substr(0, name.find_first_of(";]"));
+  }
+  template<class T>
+  constexpr auto type_name_array(){
+    constexpr auto name = type_name<T>();
+    std::array<char, name.size() + 1> r{};
+    for(size_t i = 0; i < name.size(); ++i)
+      r[i] = name[i];
+    return r;
+  }
+  
+  using factory = renderer_base*(*)(const void*);
+  using restorer = renderer_base*(*)(std::span<const std::byte>);
+  void provide(std::string_view type, factory f, restorer r = nullptr);
+  // throws if no loaded or known plugin renders values of this type.
+  // snapshot_value is the index of the recorded value, if any, that blobs
+  // the renderer keeps belong to
+  renderer_base* construct(std::string_view type, const void* value, size_t snapshot_value = -1);
+  renderer_base* restore(
+    std::string_view type,
+    std::span<const std::byte> value,
+    size_t snapshot_value = -1,
+    std::span<const std::span<const std::byte>> blobs = {}
+  );
+  
+  // values that can go into a snapshot: trivially copyable values, strings
+  // and vectors of them, and aggregates of all of these. pointers and views
+  // like std::span or std::string_view are refused, also as fields of
+  // aggregates; a class with constructors is taken as it is
+  template<class T>
+  constexpr bool is_vector = false;
+  template<class T>
+  constexpr bool is_vector<std::vector<T>> = true;
+  template<class T>
+  constexpr bool is_vector<std::basic_string<T>> = true;
+  template<class T>
+  constexpr bool is_std_array = false;
+  template<class T, size_t N>
+  constexpr bool is_std_array<std::array<T, N>> = true;
+  
+  template<class T>
+  constexpr bool encodable(){
+    if constexpr(
+      !std::default_initializable<T> || std::is_pointer_v<T> || std::is_member_pointer_v<T>
+      || std::ranges::borrowed_range<T>
+    )
+      return false;
+    else if constexpr(std::is_array_v<T>)
+      return encodable<std::remove_all_extents_t<T>>();
+    else if constexpr(is_std_array<T> || is_vector<T>)
+      return encodable<typename T::value_type>();
+    else if constexpr(std::is_aggregate_v<T>)
+      return []<size_t... I>(std::index_sequence<I...>){
+        return (encodable<boost::pfr::tuple_element_t<I, T>>() && ...);
+      }(std::make_index_sequence<boost::pfr::tuple_size_v<T>>{});
+    else
+      return std::is_trivially_copyable_v<T>;
+  }
+  
+  template<class T>
+  void encode(std::vector<std::byte>& out, const T& x){
+    auto append = [&](const void* p, size_t n){
+      out.insert(out.end(), (const std::byte*)p, (const std::byte*)p + n);
+    };
+    if constexpr(std::is_trivially_copyable_v<T>)
+      append(&x, sizeof x);
+    else if constexpr(is_vector<T>){
+      uint64_t n = x.size();
+      append(&n, sizeof n);
+      if constexpr(std::is_trivially_copyable_v<typename T::value_type>)
+        append(x.data(), n * sizeof(typename T::value_type));
+      else
+        for(auto& e:x)
+          encode(out, e);
+    }
+    else
+      boost::pfr::for_each_field(x, [&](const auto& field){ encode(out, field); });
+  }
+  
+  // throws if the value runs past the end of the data
+  template<class T>
+  void decode(std::span<const std::byte>& in, T& x){
+    auto take = [&](void* p, size_t n){
+      if(n > in.size())
+        throw std::out_of_range("truncated snapshot value");
+      std::memcpy(p, in.data(), n);
+      in = in.subspan(n);
+    };
+    if constexpr(std::is_trivially_copyable_v<T>)
+      take(&x, sizeof x);
+    else if constexpr(is_vector<T>){
+      uint64_t n = 0;
+      take(&n, sizeof n);
+      if constexpr(std::is_trivially_copyable_v<typename T::value_type>){
+        if(n > in.size() / sizeof(typename T::value_type))
+          throw std::out_of_range("truncated snapshot value");
+        x.resize(n);
+        take(x.data(), n * sizeof(typename T::value_type));
+      }
+      else{
+        if(n > in.size())
+          throw std::out_of_range("truncated snapshot value");
+        x.resize(n);
+        for(auto& e:x)
+          decode(in, e);
+      }
+    }
+    else
+      boost::pfr::for_each_field(x, [&](auto& field){ decode(in, field); });
+  }
+  
+  // remembers an added value for save_snapshot, returns its index
+  bool snapshots_enabled();
+  size_t record(std::string_view type, std::vector<std::byte> value);
 }
 
+// gpu data a renderer derives from its value, kept in snapshots so that a
+// restored renderer uploads it from the mapped file instead of deriving it
+// again. only the constructor of a renderer calls these: keep_for_snapshot
+// records data as its next blob while snapshots are enabled; restored_blob(i)
+// is its i-th blob when it is restored from a snapshot, empty otherwise
+void keep_for_snapshot(std::span<const std::byte> data);
+std::span<const std::byte> restored_blob(size_t i);
+
+// calls f(i) for i in [0, n) on the workers the library keeps for loading
+// and returns when all calls have, rethrowing the first exception; meant
+// for renderer constructors. calls from different threads take turns, f
+// must not call it again
+void parallel_for(size_t n, const std::function<void(size_t)>& f, size_t chunk = 1);
+
+// makes renderers in plugin directories visible; a plugin is only loaded
+// when a value of a type it renders is first added
+void add_plugin_directory(const char* path);
+
+// connects to a viewer; every call adds a view with its own camera and
+// input, all views are rendered together from the same scene
+void open(const char* ip, uint32_t port);
+void open(const char* ip, uint32_t port, projection p);
+
+// sort-last rendering for scenes larger than one process: each worker
+// process renders the renderers it was given and streams color and depth
+// to a compositor, which merges them by depth, serves the result to the
+// viewer at ip:port and forwards its input to all workers. frames are
+// merged in step, so the slowest worker sets the frame rate
+void open_worker(const char* ip, uint32_t port);
+void composite(const char* ip, uint32_t port, uint32_t worker_port, unsigned workers);
+
+// records spans of the render, send and input loops and writes them in
+// chrome trace-event format. VISUALIZER_TRACE=<path> enables it from the
+// start; SIGUSR1 then writes the trace to that path
+void enable_tracing(bool on);
+void dump_trace(const char* path);
+
+// gpu memory held by the process. what a renderer allocates while it is
+// constructed or its items draw is its own, everything else the core's;
+// traces carry the same numbers as counters
+struct gpu_memory_usage{
+  struct owner{
+    std::string name;
+    size_t bytes;
+  };
+  size_t total = 0;
+  size_t budget = 0;
+  // multisampling of the frame, 0 being off
+  int samples = 0;
+  std::vector<owner> owners;
+};
+gpu_memory_usage gpu_memory();
+// over budget the core frees surfaces kept for reuse, lowers multisampling
+// and asks renderers to release memory instead of failing; multisampling
+// comes back once there is room. 0, the default, is no budget.
+// VISUALIZER_GPU_BUDGET=<MiB> sets one from the start
+void set_gpu_budget(size_t bytes);
+
+// frames each view may have rendered but not yet sent. 1 renders every
+// frame right before it is sent, for interactive use; 3 or more overlap
+// render, readback and send of consecutive frames, for recording. 0, the
+// default, picks per view from the measured stage times and the rate the
+// viewer takes frames at; at most 4. VISUALIZER_FRAMES_IN_FLIGHT=<n> sets
+// it from the start
+void set_frames_in_flight(unsigned n);
+
+// once enabled, every added value whose type is snapshot-encodable is kept
+// encoded; save_snapshot writes them together with the linked program
+// binaries to a file that restore_snapshot maps and re-adds from after a
+// restart. restoring skips compiling and linking programs the driver still
+// accepts. throws on a missing, foreign or differently versioned file.
+// VISUALIZER_SNAPSHOTS=1 enables recording from the start
+void enable_snapshots(bool on);
+void save_snapshot(const char* path);
+void restore_snapshot(const char* path);
+
 template<class T>
 struct renderer{
   struct type;
@@ -40,8 +379,44 @@ struct renderer{
     //  std::constructible_from<T, type>,
     //  "your renderer must be constructible from the value you are trying to render"
     //);
-    impl::add([x]{return new type{x};});
+    size_t index = -1;
+    if constexpr(impl::encodable<T>()){
+      if(impl::snapshots_enabled()){
+        std::vector<std::byte> value;
+        impl::encode(value, x);
+        index = impl::record(impl::type_name<T>(), std::move(value));
+      }
+    }
+    impl::add([x, index]{return impl::construct(impl::type_name<T>(), &x, index);});
+  }
+  static renderer_base* make(const void* x){
+    return new type{*static_cast<const T*>(x)};
+  }
+  static renderer_base* restore(std::span<const std::byte> data){
+    if constexpr(impl::encodable<T>()){
+      T x{};
+      impl::decode(data, x);
+      return make(&x);
+    }
+    else
+      return nullptr;
   }
 };
 
 }
+
+#define VISUALIZER_PLUGIN_CONCAT_(a, b) a##b
+#define VISUALIZER_PLUGIN_CONCAT(a, b) VISUALIZER_PLUGIN_CONCAT_(a, b)
+// registers renderer<T>::type for T in a renderer library; the type name is
+// also recorded in an ELF section so the library can be found without
+// loading it
+#define VISUALIZER_PLUGIN_RENDERER(...)                                        \
+  [[gnu::used, gnu::section(".visualizer_plugin")]]                            \
+  static constexpr auto VISUALIZER_PLUGIN_CONCAT(visualizer_plugin_name_, __COUNTER__) \
+    = ::plugin::impl::type_name_array<__VA_ARGS__>();                          \
+  static const bool VISUALIZER_PLUGIN_CONCAT(visualizer_plugin_reg_, __COUNTER__) \
+    = (::plugin::impl::provide(                                                \
+        ::plugin::impl::type_name<__VA_ARGS__>(),                              \
+        &::plugin::renderer<__VA_ARGS__>::make,                                \
+        &::plugin::renderer<__VA_ARGS__>::restore                              \
+      ), true)
@@ -0,0 +1,156 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cmath>
+#include <numbers>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "visualizer-plugin/visualizer-plugin.hpp"
+#include "protocol.hpp"
+
+namespace plugin {
+struct renderer_context::pimpl {
+  glm::uvec2 res;
+  glm::vec2 dir = {};
+  glm::vec3 lookat = {};
+  glm::vec3 camera_pos = {};
+  glm::vec3 cursor_pos = {};
+  float zoom = 1;
+  float logzoom = 1;
+  glm::ivec2 mouse_pos = res / 2u;
+  struct mouse_button_bits {
+    bool left :1;
+    bool middle :1;
+    bool right :1;
+  } mouse_buttons;
+  glm::mat4 frame_matrix{1};
+  plugin::projection projection = projection::perspective;
+  
+  auto calculate_view() const  {
+    return glm::lookAt(camera_pos, lookat, {0., 1., 0.});
+  }
+  
+  glm::mat4 calculate_proj() const  {
+    auto aspect = (float) res.x / (float) res.y;
+    if(projection == projection::orthographic) {
+      auto h = 4.f * zoom;
+      return glm::ortho(-h * aspect, h * aspect, -h, h, -1000.f * zoom, 1000.f * zoom);
+    }
+    return glm::perspective(
+      glm::radians(90.f),
+      aspect,
+      0.01f * zoom,
+      1000.f * zoom
+    );
+  }
+  
+  auto calculate_matrix() const  {
+    return calculate_proj() * calculate_view();
+  }
+  
+  void calculate_zoom() { zoom = std::exp(logzoom); }
+  
+  void calculate_camera_pos() {
+    camera_pos = lookat + zoom * glm::vec3{
+      4. * std::sin(dir.x) * std::cos(dir.y),
+      -4. * std::sin(dir.y),
+      4. * std::cos(dir.x) * std::cos(dir.y)
+    };
+  }
+  
+  // camera and mouse input; false for messages that are not about them
+  bool apply(const impl::input_message &msg) {
+    using type = impl::input_type;
+    glm::ivec2 at{msg.data.x, msg.data.y};
+    switch(msg.t) {
+    case type::resize: res = at;
+      break;
+    case type::mouse_down:
+    case type::mouse_up: {
+      bool down = msg.t == type::mouse_down;
+      switch(msg.data.z) {
+      case 1: mouse_buttons.left = down;
+        break;
+      case 2: mouse_buttons.middle = down;
+        break;
+      case 3: mouse_buttons.right = down;
+        break;
+      default: break;
+      }
+      mouse_pos = at;
+    }
+      break;
+    case type::mouse_drag: {
+      auto delta = at - mouse_pos;
+      namespace num = std::numbers;
+      if(mouse_buttons.left)
+        dir = {
+          std::fmod(
+            (delta.x) / -400.f + dir.x,
+            (float) num::pi * 2.f
+          ),
+          std::clamp(
+            (delta.y) / 400.f + dir.y,
+            -(float) num::pi / 2.f,
+            (float) num::pi / 2.f
+          )
+        };
+      if(mouse_buttons.right) {
+        auto d = dir.x;
+        auto dx = delta.x / -100.f * glm::vec2{cos(d), -sin(d)};
+        auto dy = delta.y / -100.f * glm::vec2{sin(d), cos(d)};
+        auto pan = dx + dy * (float) sin(dir.y);
+        lookat += zoom * glm::vec3(pan.x, 0, pan.y);
+      }
+      if(mouse_buttons.middle) {
+        zoom += delta.y / 400.f;
+      }
+      mouse_pos = at;
+    }
+      break;
+    case type::mouse_move: mouse_pos = at;
+      break;
+    case type::scroll: {
+      double amt
+        = std::bit_cast<double>(
+          std::array<int32_t, 2>{msg.data.y, msg.data.x}
+        );
+      logzoom += amt * 0.1;
+    }
+      break;
+    default: return false;
+    }
+    return true;
+  }
+};
+
+namespace impl {
+// names the camera state behind renderer_context for the library's own
+// headers and its benchmarks
+struct camera_access{
+  using type = renderer_context::pimpl;
+};
+using camera = camera_access::type;
+
+// world position under the mouse, from the window depth of a frame drawn
+// with matrix; depth rows are stride floats apart and the view starts at
+// origin
+inline glm::vec3 cursor_position(
+  const float *depth,
+  size_t stride,
+  glm::uvec2 origin,
+  glm::uvec2 size,
+  glm::ivec2 mouse,
+  const glm::mat4 &matrix
+) {
+  auto screenspace_xy = glm::vec2(mouse) * 2.f / glm::vec2(size) - glm::vec2(1);
+  auto clamped = glm::clamp(mouse, glm::ivec2{}, (glm::ivec2) size - 1);
+  auto d = depth[origin.x + clamped.x + (origin.y + clamped.y) * stride];
+  auto p = glm::inverse(matrix) * glm::vec4(screenspace_xy, d * 2 - 1, 1);
+  return glm::vec3(p) / p.w;
+}
+}
+}
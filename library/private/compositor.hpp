@@ -0,0 +1,218 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstdint>
+#include <deque>
+#include <iostream>
+#include <list>
+#include <ranges>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <boost/asio.hpp>
+#include <boost/asio/experimental/channel.hpp>
+#include <boost/asio/experimental/parallel_group.hpp>
+#include <glm/glm.hpp>
+
+#include "protocol.hpp"
+
+namespace plugin::impl {
+// sort-last compositing: every worker renders its own share of the scene
+// with the same camera; the nearest fragment of all workers wins. viewer
+// input goes to the workers in numbered batches, a batch only once the
+// frames after the one before are merged, and workers tag their frames
+// with the last batch they got. only frames with the same id are merged,
+// one new frame from each worker, so the image never mixes two cameras
+struct compositor{
+  using tcp = boost::asio::ip::tcp;
+  template<class T>
+  using awaitable = boost::asio::awaitable<T>;
+  struct pixel{
+    char b, g, r;
+  };
+  struct frame{
+    uint32_t id = 0;
+    glm::uvec2 size{};
+    std::vector<pixel> color;
+    std::vector<float> depth;
+  };
+  // frames of a worker kept to wait for the others
+  static constexpr size_t history = 4;
+  struct worker{
+    explicit worker(tcp::socket s): socket(std::move(s)) {}
+    tcp::socket socket;
+    frame incoming;
+    // oldest first
+    std::deque<frame> recent;
+  };
+
+  compositor(): viewer(ctx), arrived(ctx, 1) {}
+
+  boost::asio::io_context ctx;
+  std::list<worker> workers;
+  tcp::socket viewer;
+  boost::asio::experimental::channel<void(boost::system::error_code)> arrived;
+  frame merged;
+  bool any_merged = false;
+  // input not yet forwarded and the id of the last batch that was
+  std::vector<std::array<char, sizeof(input_message)>> pending;
+  uint32_t batch = 0;
+  bool flushing = false;
+
+  void run(std::string ip, uint32_t port, uint32_t worker_port, unsigned count){
+    boost::asio::co_spawn(ctx, serve(ip, port, worker_port, count), [](std::exception_ptr e){
+      if(!e)
+        return;
+      try { std::rethrow_exception(e); }
+      catch(std::exception& x){ std::cerr << "compositor: " << x.what() << "\n"; }
+    });
+    ctx.run();
+  }
+
+  awaitable<void> serve(std::string ip, uint32_t port, uint32_t worker_port, unsigned count){
+    using boost::asio::use_awaitable;
+    tcp::acceptor acceptor(ctx, {tcp::v4(), (unsigned short) worker_port});
+    while(workers.size() < count)
+      workers.emplace_back(co_await acceptor.async_accept(use_awaitable));
+    std::cerr << "compositor: " << count << " workers connected\n";
+    // the first worker alone draws what every worker would, like the
+    // transparent ground plane, so that it is blended once
+    int index = 0;
+    for(auto& w:workers){
+      input_message msg{{index++, (int)count, 0}, input_type::worker_index};
+      encode(msg);
+      co_await async_write(w.socket, boost::asio::buffer(&msg, sizeof msg), use_awaitable);
+    }
+    co_await viewer.async_connect({boost::asio::ip::address::from_string(ip), (unsigned short) port}, use_awaitable);
+    for(auto& w:workers)
+      boost::asio::co_spawn(ctx, receive(w), boost::asio::detached);
+    co_await boost::asio::experimental::make_parallel_group(
+      boost::asio::co_spawn(ctx, forward_input(), boost::asio::deferred),
+      boost::asio::co_spawn(ctx, send_merged(), boost::asio::deferred)
+    ).async_wait(boost::asio::experimental::wait_for_one_error(), use_awaitable);
+  }
+
+  awaitable<void> receive(worker& w){
+    using boost::asio::use_awaitable;
+    for(;;){
+      frame_header header;
+      co_await async_read(w.socket, boost::asio::buffer(&header, sizeof header), use_awaitable);
+      glm::uvec2 size{std::byteswap(header.w), std::byteswap(header.h)};
+      auto total = std::byteswap(header.total);
+      auto pixels = size.x * size.y;
+      if(header.magic != depth_frame || total != sizeof(uint32_t) + pixels * (sizeof(pixel) + sizeof(float)))
+        throw std::runtime_error("compositor: malformed worker frame");
+      auto& f = w.incoming;
+      f.size = size;
+      f.color.resize(pixels);
+      f.depth.resize(pixels);
+      co_await async_read(
+        w.socket,
+        std::array{
+          boost::asio::buffer(&f.id, sizeof f.id),
+          boost::asio::buffer(f.color),
+          boost::asio::buffer(f.depth)
+        },
+        use_awaitable
+      );
+      f.id = std::byteswap(f.id);
+      w.recent.push_back(std::move(f));
+      // the dropped frame's storage is reused
+      if(w.recent.size() > history){
+        w.incoming = std::move(w.recent.front());
+        w.recent.pop_front();
+      }
+      else
+        w.incoming = {};
+      arrived.try_send(boost::system::error_code{});
+    }
+  }
+
+  // viewer input drives the camera of every worker
+  awaitable<void> forward_input(){
+    using boost::asio::use_awaitable;
+    std::array<char, sizeof(input_message)> msg;
+    for(;;){
+      co_await async_read(viewer, boost::asio::buffer(msg), use_awaitable);
+      pending.push_back(msg);
+      co_await flush();
+    }
+  }
+  // sends pending input as the next batch once the last one is merged;
+  // whoever flushes first writes for both callers
+  awaitable<void> flush(){
+    using boost::asio::use_awaitable;
+    if(flushing)
+      co_return;
+    flushing = true;
+    while(!pending.empty() && any_merged && merged.id == batch){
+      auto messages = std::exchange(pending, {});
+      input_message marker{{(int) ++batch, 0, 0}, input_type::frame_id};
+      encode(marker);
+      std::array buffers{boost::asio::buffer(messages), boost::asio::buffer(&marker, sizeof marker)};
+      for(auto& w:workers)
+        co_await async_write(w.socket, buffers, use_awaitable);
+    }
+    flushing = false;
+  }
+
+  // the newest frame of w with that id
+  static frame* find(worker& w, uint32_t id){
+    auto it = std::ranges::find(w.recent | std::views::reverse, id, &frame::id);
+    return it == w.recent.rend() ? nullptr : &*it;
+  }
+  bool merge(){
+    auto& head = workers.front();
+    std::vector<frame*> set;
+    for(auto& candidate:head.recent | std::views::reverse){
+      if(any_merged && candidate.id < merged.id)
+        break;
+      set.clear();
+      for(auto& w:workers){
+        auto f = find(w, candidate.id);
+        if(!f || f->size != candidate.size)
+          break;
+        set.push_back(f);
+      }
+      if(set.size() == workers.size())
+        break;
+    }
+    if(set.size() != workers.size())
+      return false;
+    auto& first = *set.front();
+    merged.id = first.id;
+    merged.size = first.size;
+    merged.color = first.color;
+    merged.depth = first.depth;
+    for(auto* f:set | std::views::drop(1))
+      for(size_t i = 0; i < merged.depth.size(); ++i)
+        if(f->depth[i] < merged.depth[i]){
+          merged.depth[i] = f->depth[i];
+          merged.color[i] = f->color[i];
+        }
+    any_merged = true;
+    for(auto& w:workers)
+      std::erase_if(w.recent, [&](const frame& f){ return f.id <= merged.id; });
+    return true;
+  }
+
+  awaitable<void> send_merged(){
+    using boost::asio::use_awaitable;
+    for(;;){
+      co_await arrived.async_receive(use_awaitable);
+      if(!merge())
+        continue;
+      auto total = merged.color.size() * sizeof(pixel);
+      auto header = make_header(color_frame, merged.size, total);
+      co_await async_write(
+        viewer,
+        std::array{boost::asio::buffer(&header, sizeof header), boost::asio::buffer(merged.color)},
+        use_awaitable
+      );
+      co_await flush();
+    }
+  }
+};
+}
@@ -0,0 +1,29 @@
+#pragma once
+#include <cstddef>
+#include <functional>
+#include <mutex>
+
+#include <boost/lockfree/spsc_queue.hpp>
+
+#include "visualizer-plugin/visualizer-plugin.hpp"
+
+namespace plugin::impl {
+// renderer constructors on their way to the loader thread, which pops them.
+// values are added from any thread, so producers take turns on a lock; the
+// loader is the only consumer and pops without one
+struct constructor_queue{
+  using constructor = std::function<renderer_base*()>;
+  static constexpr size_t capacity = 1024;
+  // false while full
+  bool push(const constructor& f){
+    std::lock_guard lock(producers);
+    return queue.push(f);
+  }
+  bool pop(constructor& f){
+    return queue.pop(f);
+  }
+private:
+  std::mutex producers;
+  boost::lockfree::spsc_queue<constructor> queue{capacity};
+};
+}
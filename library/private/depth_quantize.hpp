@@ -0,0 +1,41 @@
+#pragma once
+#include <algorithm>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace plugin::impl {
+// window depth in [0, 1] to big endian 16 bit, 65535 being the far plane
+inline uint16_t quantize_depth(float d){
+  auto q = (uint16_t)(std::clamp(d, 0.f, 1.f) * 65535.f + 0.5f);
+  return std::byteswap(q);
+}
+
+inline void quantize_depth(const float* src, uint16_t* dst, size_t n){
+  size_t i = 0;
+#ifdef __SSE2__
+  // sse2 has no unsigned 32 to 16 bit pack, values are biased into the
+  // signed range and back
+  auto zero = _mm_setzero_ps(), one = _mm_set1_ps(1.f);
+  auto scale = _mm_set1_ps(65535.f), half = _mm_set1_ps(0.5f);
+  auto bias = _mm_set1_epi32(32768);
+  auto unbias = _mm_set1_epi16((short)0x8000);
+  for(; i + 8 <= n; i += 8){
+    auto quantize = [&](const float* p){
+      auto d = _mm_min_ps(_mm_max_ps(_mm_loadu_ps(p), zero), one);
+      auto q = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(d, scale), half));
+      return _mm_sub_epi32(q, bias);
+    };
+    auto packed = _mm_xor_si128(_mm_packs_epi32(quantize(src + i), quantize(src + i + 4)), unbias);
+    auto swapped = _mm_or_si128(_mm_slli_epi16(packed, 8), _mm_srli_epi16(packed, 8));
+    _mm_storeu_si128((__m128i*)(dst + i), swapped);
+  }
+#endif
+  for(; i < n; ++i)
+    dst[i] = quantize_depth(src[i]);
+}
+}
@@ -0,0 +1,38 @@
+#pragma once
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+#include "link_monitor.hpp"
+
+namespace plugin::impl {
+// how many frames of a view may be rendered but not yet sent. with one,
+// each frame is rendered right before it is sent; more let render, readback
+// and send of consecutive frames overlap. the automatic depth overlaps only
+// as far as needed for the stages to keep up with the frames the link takes
+struct frame_pipeline{
+  using clock = link_monitor::clock;
+  static constexpr unsigned max_depth = 4;
+  enum stage{
+    render,
+    gpu,
+    send
+  };
+
+  void measured(stage s, clock::duration took){
+    auto seconds = std::chrono::duration<double>(took).count();
+    times[s] = times[s] ? times[s] * 0.8 + seconds * 0.2 : seconds;
+  }
+  // setting 0 is automatic, for a view that wants a frame every interval
+  unsigned depth(unsigned setting, clock::duration interval) const{
+    if(setting)
+      return std::clamp(setting, 1u, max_depth);
+    auto total = times[render] + times[gpu] + times[send];
+    auto slowest = std::max({times[render], times[gpu], times[send], std::chrono::duration<double>(interval).count()});
+    if(slowest <= 0)
+      return 1;
+    return std::clamp((unsigned)std::ceil(total / slowest), 1u, max_depth);
+  }
+  double times[3]{};
+};
+}
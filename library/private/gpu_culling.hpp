@@ -0,0 +1,212 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <exception>
+#include <iostream>
+#include <numeric>
+#include <span>
+#include <tuple>
+#include <vector>
+
+#include "visualizer-plugin/visualizer-plugin.hpp"
+#include "visualizer-plugin/abstraction/gl.hpp"
+#include "resources.hpp"
+
+namespace plugin::impl {
+// culls the gpu objects of the scene in a compute pass and draws what is
+// left with one indirect call per batch. occlusion is tested against the
+// previous frame only, so an object that an occluder moving under a resting
+// camera uncovers shows up a frame late.
+// where the compute shaders do not build, every object is drawn unculled
+struct gpu_culling{
+  // std430 layouts of cull.comp
+  struct object{
+    glm::vec4 sphere;
+    uint32_t count;
+    uint32_t first_index;
+    int32_t base_vertex;
+    uint32_t base_instance;
+    uint32_t instances;
+    uint32_t batch;
+    uint32_t command_base;
+    uint32_t pad;
+  };
+  struct command{
+    uint32_t count;
+    uint32_t instances;
+    uint32_t first_index;
+    int32_t base_vertex;
+    uint32_t base_instance;
+  };
+  // objects [begin, end) share program, vertex array and mode
+  struct batch{
+    unsigned program, vao, mode;
+    uint32_t begin, end;
+    void (*prepare)(void*, const renderer_context);
+    void* user;
+  };
+  // where and with which matrix a view was drawn into the depth pyramid
+  struct hiz_view{
+    gl::ubox2 rect;
+    glm::mat4 matrix;
+  };
+
+  gl::program cull_p, hiz_p;
+  gl::buffer<object> objects;
+  gl::buffer<command> commands;
+  gl::buffer<uint32_t> counts;
+  std::vector<batch> batches;
+  // what the unculled draws read
+  std::vector<object> data;
+  uint32_t object_count = 0;
+  // without a draw count read from a buffer, culled commands stay in place
+  // with no instances
+  bool compact = GLEW_VERSION_4_6 || GLEW_ARB_indirect_parameters;
+  PFNGLMULTIDRAWELEMENTSINDIRECTCOUNTARBPROC draw_count = GLEW_VERSION_4_6
+    ? glMultiDrawElementsIndirectCount
+    : glMultiDrawElementsIndirectCountARB;
+  gl::texture depth, hiz;
+  std::vector<hiz_view> hiz_views;
+
+  gpu_culling(){
+    try {
+      cull_p = {gl::shader<gl::shader_type::compute>{get_file("shaders/cull.comp")}};
+      hiz_p = {gl::shader<gl::shader_type::compute>{get_file("shaders/hiz.comp")}};
+    }
+    catch(std::exception& e){
+      std::cerr << "gpu culling disabled: " << e.what() << "\n";
+      cull_p = {};
+    }
+  }
+
+  void set(std::span<const gpu_object> scene){
+    std::vector<uint32_t> order(scene.size());
+    std::iota(order.begin(), order.end(), 0);
+    auto key = [&](uint32_t i){
+      return std::tuple{scene[i].program, scene[i].vao, scene[i].mode};
+    };
+    std::ranges::stable_sort(order, {}, key);
+    data.clear();
+    data.reserve(order.size());
+    batches.clear();
+    for(auto i:order){
+      auto& x = scene[i];
+      if(batches.empty() || key(i) != std::tuple{batches.back().program, batches.back().vao, batches.back().mode})
+        batches.push_back({x.program, x.vao, x.mode, (uint32_t)data.size(), 0, x.prepare, x.user});
+      batches.back().end = data.size() + 1;
+      data.push_back({
+        glm::vec4(x.center, x.radius),
+        x.count,
+        x.first_index,
+        x.base_vertex,
+        x.base_instance,
+        x.instances,
+        (uint32_t)batches.size() - 1,
+        batches.back().begin,
+        0
+      });
+    }
+    object_count = data.size();
+    if(data.empty() || !cull_p)
+      return;
+    objects = gl::buffer<object>(std::span<const object>(data), 0);
+    commands = gl::buffer<command>(data.size(), 0);
+    counts = gl::buffer<uint32_t>(batches.size(), 0);
+  }
+
+  // fills the command buffer for one view
+  void cull(const glm::mat4& matrix, gl::ubox2 rect){
+    if(!object_count || !cull_p)
+      return;
+    uint32_t zero = 0;
+    if(compact)
+      glClearNamedBufferData(counts.native(), GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, &zero);
+    std::array<glm::vec4, 6> planes;
+    auto rows = glm::transpose(matrix);
+    for(int i = 0; i < 3; ++i){
+      planes[2 * i] = rows[3] + rows[i];
+      planes[2 * i + 1] = rows[3] - rows[i];
+    }
+    for(auto& p:planes)
+      p /= glm::length(glm::vec3(p));
+    // the pyramid only holds what this view sees now if it did not move
+    bool occlusion = hiz && std::ranges::any_of(hiz_views, [&](const hiz_view& v){
+      return v.rect.min == rect.min && v.rect.max == rect.max && v.matrix == matrix;
+    });
+    cull_p.bind();
+    glUniformMatrix4fv(cull_p.uniform_loc("mvp"), 1, false, &matrix[0][0]);
+    glUniform4fv(cull_p.uniform_loc("planes"), 6, &planes[0][0]);
+    glUniform1ui(cull_p.uniform_loc("object_count"), object_count);
+    glUniform1i(cull_p.uniform_loc("compact"), compact);
+    glUniform1i(cull_p.uniform_loc("occlusion"), occlusion);
+    glUniform2f(cull_p.uniform_loc("view_min"), rect.min.x, rect.min.y);
+    glUniform2f(cull_p.uniform_loc("view_size"), rect.max.x - rect.min.x, rect.max.y - rect.min.y);
+    if(occlusion)
+      hiz.bind(0);
+    objects.bind(gl::bind_point::shader_storage, 0);
+    commands.bind(gl::bind_point::shader_storage, 1);
+    counts.bind(gl::bind_point::shader_storage, 2);
+    glDispatchCompute((object_count + 63) / 64, 1, 1);
+    glMemoryBarrier(GL_COMMAND_BARRIER_BIT);
+  }
+
+  void draw(const renderer_context& c){
+    auto& state = gl::state::current();
+    for(size_t i = 0; i < batches.size(); ++i){
+      auto& b = batches[i];
+      state.use_program(b.program);
+      state.bind_vertex_array(b.vao);
+      if(b.prepare)
+        b.prepare(b.user, c);
+      if(!cull_p){
+        for(auto& o:std::span(data).subspan(b.begin, b.end - b.begin))
+          glDrawElementsInstancedBaseVertexBaseInstance(
+            b.mode, o.count, GL_UNSIGNED_INT, (const void*)(o.first_index * sizeof(uint32_t)),
+            o.instances, o.base_vertex, o.base_instance
+          );
+        continue;
+      }
+      commands.bind(gl::bind_point::draw_indirect);
+      auto offset = (const void*)(b.begin * sizeof(command));
+      if(compact){
+        state.bind_buffer(GL_PARAMETER_BUFFER, counts.native());
+        draw_count(b.mode, GL_UNSIGNED_INT, offset, i * sizeof(uint32_t), b.end - b.begin, 0);
+      }
+      else
+        glMultiDrawElementsIndirect(b.mode, GL_UNSIGNED_INT, offset, b.end - b.begin, 0);
+    }
+  }
+
+  // keeps the depth of the frame just resolved as a max pyramid, which the
+  // next frame culls against
+  void build_hiz(const gl::renderbuffer& resolved, glm::uvec2 size, std::vector<hiz_view> views){
+    if(!object_count || !cull_p || !size.x || !size.y)
+      return;
+    if(depth.size() != size){
+      depth = gl::texture(size, GL_DEPTH_COMPONENT32F);
+      hiz = gl::texture(size, GL_R32F, gl::texture::full_chain(size));
+    }
+    glCopyImageSubData(
+      resolved.native(), GL_RENDERBUFFER, 0, 0, 0, 0,
+      depth.native(), GL_TEXTURE_2D, 0, 0, 0, 0,
+      size.x, size.y, 1
+    );
+    hiz_p.bind();
+    depth.bind(0);
+    for(int level = 0; level < hiz.levels(); ++level){
+      auto src = hiz.size(std::max(level - 1, 0)), dst = hiz.size(level);
+      if(level)
+        hiz.bind_image(0, level - 1, GL_READ_ONLY);
+      hiz.bind_image(1, level, GL_WRITE_ONLY);
+      glUniform1i(hiz_p.uniform_loc("from_depth"), level == 0);
+      glUniform2i(hiz_p.uniform_loc("src_size"), src.x, src.y);
+      glUniform2i(hiz_p.uniform_loc("dst_size"), dst.x, dst.y);
+      glDispatchCompute((dst.x + 7) / 8, (dst.y + 7) / 8, 1);
+      glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+    }
+    glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+    hiz_views = std::move(views);
+  }
+};
+}
@@ -0,0 +1,56 @@
+#pragma once
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+
+#ifdef __linux__
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#endif
+
+namespace plugin::impl {
+// estimates what a viewer connection can sustain so the renderer can slow
+// down before frames pile up in the socket buffers
+struct link_monitor{
+  using clock = std::chrono::steady_clock;
+  static constexpr auto min_interval = std::chrono::microseconds(1'000'000 / 120);
+  
+  void sent(std::size_t bytes, clock::duration took){
+    auto seconds = std::chrono::duration<double>(took).count();
+    if(seconds <= 0)
+      return;
+    auto rate = bytes / seconds;
+    throughput = throughput ? throughput * 0.8 + rate * 0.2 : rate;
+  }
+  void sample(int fd){
+#ifdef __linux__
+    tcp_info info{};
+    socklen_t len = sizeof info;
+    if(!getsockopt(fd, IPPROTO_TCP, TCP_INFO, &info, &len))
+      rtt = std::chrono::microseconds(info.tcpi_rtt);
+    int pending = 0;
+    if(!ioctl(fd, TIOCOUTQ, &pending))
+      queued = pending;
+#endif
+  }
+  // time to wait between two frames of the given size; data the kernel
+  // still holds beyond one bandwidth-delay product is drained first
+  clock::duration frame_interval(std::size_t frame_bytes) const{
+    if(!throughput)
+      return min_interval;
+    auto bdp = throughput * std::chrono::duration<double>(rtt).count();
+    auto backlog = std::max(0., queued - bdp);
+    auto seconds = (frame_bytes + backlog) / throughput;
+    return std::max<clock::duration>(
+      min_interval,
+      std::chrono::duration_cast<clock::duration>(std::chrono::duration<double>(seconds))
+    );
+  }
+  double throughput = 0;
+  clock::duration rtt{};
+  std::size_t queued = 0;
+  std::size_t dropped = 0;
+};
+}
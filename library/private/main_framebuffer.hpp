@@ -1,4 +1,8 @@
 #pragma once
+#include<algorithm>
+#include<bit>
+#include<span>
+#include<vector>
 #include"visualizer-plugin/abstraction/gl.hpp"
 
 namespace plugin::impl {
@@ -6,62 +10,231 @@ struct main_framebuffer{
   struct client_memory{
     gl::buffer<glm::tvec3<char>> color_image;
     gl::buffer<float> depth_image;
-    glm::uvec2 size{};
+    // where each region read starts in the images, in pixels, and whether
+    // its depth was read too; rows of a region are tightly packed
+    struct part{
+      size_t offset;
+      bool has_depth;
+    };
+    std::vector<part> parts;
+    bool has_depth = false;
+    // signalled once the readback into the buffers has finished
+    GLsync ready = nullptr;
   };
-  void initiate_transfer(client_memory& memory){
-    auto total_res = read_buffer_res.x * read_buffer_res.y;
-    memory.size = read_buffer_res;
-    if(memory.color_image.size() < total_res)
-      memory.color_image.resize(total_res);
-    if(memory.depth_image.size() < total_res)
-      memory.depth_image.resize(total_res);
-    read_fb.read_pixels(memory.color_image, {{},read_buffer_res}, GL_COLOR_ATTACHMENT0, GL_BGR);
-    read_fb.read_pixels(memory.depth_image, {{}, read_buffer_res}, GL_COLOR_ATTACHMENT0, GL_DEPTH_COMPONENT);
+  // frames a smaller size class has to be requested before storage shrinks
+  static constexpr unsigned shrink_delay = 60;
+  struct surface{
+    surface(glm::uvec2 size, int samples):
+      color{size, GL_RGBA8, samples},
+      depth{size, GL_DEPTH_COMPONENT32F, samples},
+      size(size),
+      samples(samples)
+    {
+      fb.attach(color, GL_COLOR_ATTACHMENT0);
+      fb.attach(depth, GL_DEPTH_ATTACHMENT);
+      fb.read_on(GL_COLOR_ATTACHMENT0);
+      fb.draw_on({GL_COLOR_ATTACHMENT0});
+    }
+    // color and depth, each 4 bytes per sample
+    size_t bytes() const{
+      return (size_t)size.x * size.y * 8 * std::max(samples, 1);
+    }
+    gl::renderbuffer color, depth;
+    gl::framebuffer fb;
+    glm::uvec2 size;
+    int samples;
+  };
+  // released surfaces are kept around for a while, a window that is resized
+  // back and forth keeps hitting the same few size classes. the pool holds
+  // at most capacity bytes, oldest first out, and drops what was not
+  // reused within shrink_delay frames
+  struct surface_pool{
+    static constexpr size_t capacity = size_t(1) << 28;
+    struct pooled{
+      surface s;
+      unsigned released;
+    };
+    surface acquire(glm::uvec2 size, int samples){
+      auto it = std::ranges::find_if(surfaces, [&](pooled& p){
+        return p.s.size == size && p.s.samples == samples;
+      });
+      if(it == surfaces.end())
+        return {size, samples};
+      surface s = std::move(it->s);
+      bytes -= s.bytes();
+      surfaces.erase(it);
+      return s;
+    }
+    void release(surface s){
+      bytes += s.bytes();
+      surfaces.push_back({std::move(s), frame});
+      while(bytes > capacity)
+        drop_oldest();
+    }
+    // once per frame
+    void tick(){
+      ++frame;
+      while(!surfaces.empty() && frame - surfaces.front().released > shrink_delay)
+        drop_oldest();
+    }
+    void clear(){
+      surfaces.clear();
+      bytes = 0;
+    }
+    // oldest first
+    std::vector<pooled> surfaces;
+    size_t bytes = 0;
+    unsigned frame = 0;
+  private:
+    void drop_oldest(){
+      bytes -= surfaces.front().s.bytes();
+      surfaces.erase(surfaces.begin());
+    }
+  };
+  // storage is allocated in steps of 1.5x per dimension; the frame is
+  // rendered into the bottom left corner of it
+  static unsigned size_class(unsigned x){
+    unsigned c = std::max(256u, std::bit_floor(std::max(x, 1u)));
+    if(c >= x)
+      return c;
+    if(c + c / 2 >= x)
+      return c + c / 2;
+    return c * 2;
   }
+  static glm::uvec2 size_class(glm::uvec2 size){
+    return {size_class(size.x), size_class(size.y)};
+  }
+  // a part of the resolved frame to read back, or of the thumbnails
+  struct region{
+    gl::ubox2 rect;
+    bool thumbnail = false;
+    bool depth = false;
+  };
+  
+  // starts reading regions of the last resolved frame into memory, one
+  // after the other; depth only where it was resolved and is asked for
+  void initiate_transfer(client_memory& memory, std::span<const region> regions){
+    size_t total = 0;
+    memory.parts.clear();
+    memory.has_depth = false;
+    for(auto& r:regions){
+      bool depth = r.depth && !r.thumbnail && resolved_depth;
+      memory.parts.push_back({total, depth});
+      memory.has_depth |= depth;
+      total += (r.rect.max.x - r.rect.min.x) * (r.rect.max.y - r.rect.min.y);
+    }
+    if(memory.color_image.size() < total)
+      memory.color_image.resize(total);
+    if(memory.has_depth && memory.depth_image.size() < total)
+      memory.depth_image.resize(total);
+    for(size_t i = 0; i < regions.size(); ++i){
+      auto& r = regions[i];
+      auto& from = r.thumbnail ? thumbnails.fb : read.fb;
+      auto [offset, depth] = memory.parts[i];
+      from.read_pixels(memory.color_image, r.rect, GL_COLOR_ATTACHMENT0, GL_BGR, offset);
+      if(depth)
+        from.read_pixels(memory.depth_image, r.rect, GL_COLOR_ATTACHMENT0, GL_DEPTH_COMPONENT, offset);
+    }
+    if(memory.ready)
+      glDeleteSync(memory.ready);
+    memory.ready = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+  }
+  // once per frame
   void resize(glm::uvec2 size){
+    pool.tick();
     write_buffer_res = size;
-    if(write_depth_buffer.size() != size)
-      write_depth_buffer.resize(size);
-    if(write_color_buffer.size() != size)
-      write_color_buffer.resize(size);
+    auto wanted = glm::min(size_class(size), max_size());
+    if(wanted == write.size)
+      shrink_frames = 0;
+    else if(wanted.x > write.size.x || wanted.y > write.size.y)
+      reallocate(glm::max(wanted, write.size));
+    else if(++shrink_frames >= shrink_delay)
+      reallocate(wanted);
   }
-  void swap(){
+  // multisample resolve of the frame just drawn; depth is only resolved
+  // when someone is going to read it
+  void resolve(bool depth){
     read_buffer_res = write_buffer_res;
-    read_depth_buffer.resize(write_depth_buffer.size());
-    read_color_buffer.resize(write_color_buffer.size());
-    read_fb.bind(1,0);
-    write_fb.bind(0,1);
-    blit(read_fb, {{}, read_buffer_res}, write_fb, {{}, write_buffer_res}, false);
-    blit(read_fb, {{}, read_buffer_res}, write_fb, {{}, write_buffer_res}, true);
+    resolved_depth = depth;
+    blit(read.fb, {{}, read_buffer_res}, write.fb, {{}, write_buffer_res}, depth);
+  }
+  // the largest surface the context can allocate and draw into
+  static glm::uvec2 max_size(){
+    static glm::uvec2 size = []{
+      GLint renderbuffer = 0, width = 0, height = 0;
+      glGetIntegerv(GL_MAX_RENDERBUFFER_SIZE, &renderbuffer);
+      glGetIntegerv(GL_MAX_FRAMEBUFFER_WIDTH, &width);
+      glGetIntegerv(GL_MAX_FRAMEBUFFER_HEIGHT, &height);
+      return glm::uvec2(std::min(renderbuffer, width), std::min(renderbuffer, height));
+    }();
+    return size;
+  }
+  // downscaled parts of the resolved frame go into a surface of their own;
+  // size has to be within max_size()
+  void reserve_thumbnails(glm::uvec2 size){
+    if(size.x <= thumbnails.size.x && size.y <= thumbnails.size.y)
+      return;
+    auto wanted = glm::min(size_class(glm::max(size, thumbnails.size)), max_size());
+    pool.release(std::move(thumbnails));
+    thumbnails = pool.acquire(wanted, 0);
+  }
+  void downscale(gl::ubox2 src, gl::ubox2 dst){
+    blit(thumbnails.fb, dst, read.fb, src, false, GL_LINEAR);
+  }
+  // multisampling of the frame, 0 being off; lowered to stay in the gpu
+  // memory budget
+  int samples() const{
+    return write_samples;
+  }
+  void set_samples(int samples){
+    if(samples == write_samples)
+      return;
+    write_samples = samples;
+    auto size = write.size;
+    pool.release(std::move(write));
+    write = pool.acquire(size, samples);
+  }
+  // what the frame would take more with that many samples
+  size_t samples_cost(int samples) const{
+    auto pixels = (size_t)write.size.x * write.size.y;
+    return pixels * 8 * std::max(samples, 1) - write.bytes();
+  }
+  // frees the surfaces kept for reuse
+  void trim(){
+    pool.clear();
   }
   void bind(){
-    write_fb.bind(1,0);
-    glViewport(0,0,write_buffer_res.x, write_buffer_res.y);
-    glClearColor(0.1,0.1,0.1,0);
+    write.fb.bind(1,0);
+    auto& gl_state = gl::state::current();
+    gl_state.viewport({0, 0, write_buffer_res.x, write_buffer_res.y});
+    gl_state.clear_color({0.1, 0.1, 0.1, 0});
+    gl_state.depth_mask(true);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
   }
   main_framebuffer(glm::uvec2 res):
     read_buffer_res(res),
     write_buffer_res(res),
-    read_color_buffer{res, GL_RGBA8, 0},
-    write_color_buffer{res, GL_RGBA8, 16},
-    read_depth_buffer{res, GL_DEPTH_COMPONENT, 0},
-    write_depth_buffer{res, GL_DEPTH_COMPONENT, 16}
-  {
-    read_fb.attach(read_color_buffer, GL_COLOR_ATTACHMENT0);
-    write_fb.attach(write_color_buffer, GL_COLOR_ATTACHMENT0);
-    read_fb.attach(read_depth_buffer, GL_DEPTH_ATTACHMENT);
-    write_fb.attach(write_depth_buffer, GL_DEPTH_ATTACHMENT);
-    write_fb.read_on(GL_COLOR_ATTACHMENT0);
-    read_fb .read_on(GL_COLOR_ATTACHMENT0);
-    write_fb.draw_on({GL_COLOR_ATTACHMENT0});
-    read_fb .draw_on({GL_COLOR_ATTACHMENT0});
-  }
+    read{size_class(res), 0},
+    write{size_class(res), max_samples},
+    thumbnails{size_class({1, 1}), 0}
+  {}
   glm::uvec2 read_buffer_res;
   glm::uvec2 write_buffer_res;
-  gl::renderbuffer read_color_buffer, write_color_buffer;
-  gl::renderbuffer read_depth_buffer, write_depth_buffer;
-  gl::framebuffer read_fb;
-  gl::framebuffer write_fb;
+  surface_pool pool;
+  surface read;
+  surface write;
+  surface thumbnails;
+  unsigned shrink_frames = 0;
+  bool resolved_depth = false;
+  static constexpr int max_samples = 16;
+private:
+  void reallocate(glm::uvec2 size){
+    shrink_frames = 0;
+    pool.release(std::move(write));
+    write = pool.acquire(size, write_samples);
+    pool.release(std::move(read));
+    read = pool.acquire(size, 0);
+  }
+  int write_samples = max_samples;
 };
 }
@@ -1,18 +1,11 @@
 #pragma once
 #include"visualizer-plugin/visualizer-plugin.hpp"
 #include"visualizer-plugin/abstraction/gl.hpp"
-
-#include <cmrc/cmrc.hpp>
-
-CMRC_DECLARE(visualizer_plugin);
+#include"resources.hpp"
 
 namespace plugin{
 namespace impl{
 struct plane_type{};
-inline std::string_view get_file(const char* path){
-  auto file = cmrc::visualizer_plugin::get_filesystem().open(path);
-  return {file.begin(), file.end()};
-}
 }
 template<>
 struct renderer<impl::plane_type>:renderer_base{
@@ -32,9 +25,10 @@ struct renderer<impl::plane_type>:renderer_base{
     glUniform3f(plane_p.uniform_loc("offset"), ctx.focus().x, ctx.focus().y, ctx.focus().z);
     glUniform1f(plane_p.uniform_loc("scale"), 1/ctx.camera_scale());
     glUniformMatrix4fv(plane_p.uniform_loc("mvp"), 1, false, &mat[0][0]);
-    glDisable(GL_CULL_FACE);
+    auto& gl_state = gl::state::current();
+    gl_state.disable(GL_CULL_FACE);
     glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
-    glEnable(GL_CULL_FACE);
+    gl_state.enable(GL_CULL_FACE);
   }
 };
 
@@ -0,0 +1,116 @@
+#pragma once
+#include <algorithm>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <ranges>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <dlfcn.h>
+#include <elf.h>
+
+#include "visualizer-plugin/visualizer-plugin.hpp"
+
+namespace plugin::impl {
+// type names listed in the .visualizer_plugin section of a shared library,
+// read straight from the file so nothing gets loaded
+inline std::vector<std::string> provided_types(const std::filesystem::path& path){
+  std::ifstream file(path, std::ios::binary);
+  Elf64_Ehdr header{};
+  if(!file.read((char*)&header, sizeof header)
+    || std::string_view((char*)header.e_ident, SELFMAG) != ELFMAG
+    || header.e_ident[EI_CLASS] != ELFCLASS64
+    || header.e_shstrndx == SHN_UNDEF)
+    return {};
+  std::vector<Elf64_Shdr> sections(header.e_shnum);
+  file.seekg(header.e_shoff);
+  if(!file.read((char*)sections.data(), sections.size() * sizeof(Elf64_Shdr)))
+    return {};
+  auto read_section = [&](const Elf64_Shdr& s){
+    std::string data(s.sh_size, '\0');
+    file.seekg(s.sh_offset);
+    file.read(data.data(), data.size());
+    return data;
+  };
+  auto names = read_section(sections[header.e_shstrndx]);
+  for(auto& s:sections){
+    if(s.sh_name >= names.size() || names.c_str() + s.sh_name != std::string_view(".visualizer_plugin"))
+      continue;
+    auto data = read_section(s);
+    std::vector<std::string> types;
+    for(size_t i = 0; i < data.size();){
+      auto end = std::min(data.find('\0', i), data.size());
+      if(end > i)
+        types.emplace_back(data, i, end - i);
+      i = end + 1;
+    }
+    return types;
+  }
+  return {};
+}
+
+struct plugin_registry{
+  static plugin_registry& get(){
+    static plugin_registry r;
+    return r;
+  }
+  struct entry{
+    factory make = nullptr;
+    restorer restore = nullptr;
+  };
+  void provide(std::string_view type, factory f, restorer r){
+    std::lock_guard lock(m);
+    factories.insert_or_assign(std::string(type), entry{f, r});
+  }
+  void scan(const std::filesystem::path& dir){
+    std::error_code ec;
+    for(auto& entry:std::filesystem::directory_iterator(dir, ec)){
+      if(entry.path().extension() != ".so")
+        continue;
+      auto types = provided_types(entry.path());
+      std::lock_guard lock(m);
+      for(auto& type:types)
+        providers.try_emplace(type, entry.path());
+    }
+  }
+  entry find(std::string_view type){
+    std::unique_lock lock(m);
+    if(auto it = factories.find(type); it != factories.end())
+      return it->second;
+    auto it = providers.find(type);
+    if(it == providers.end())
+      return {};
+    auto path = it->second;
+    providers.erase(it);
+    // the library registers its factories from its static initializers,
+    // which take the lock themselves
+    lock.unlock();
+    auto handle = dlopen(path.c_str(), RTLD_NOW | RTLD_LOCAL);
+    if(!handle)
+      throw std::runtime_error(dlerror());
+    lock.lock();
+    handles.push_back(handle);
+    if(auto it = factories.find(type); it != factories.end())
+      return it->second;
+    return {};
+  }
+private:
+  plugin_registry(){
+    if(auto path = std::getenv("VISUALIZER_PLUGIN_PATH")){
+      std::string_view dirs = path;
+      for(auto dir:std::views::split(dirs, ':'))
+        if(!std::ranges::empty(dir))
+          scan(std::string_view(dir.begin(), dir.end()));
+    }
+  }
+  std::mutex m;
+  std::map<std::string, entry, std::less<>> factories;
+  std::map<std::string, std::filesystem::path, std::less<>> providers;
+  std::vector<void*> handles;
+};
+}
@@ -0,0 +1,82 @@
+#pragma once
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+
+#include <glm/glm.hpp>
+
+namespace plugin::impl {
+// w, h and total are big endian; total counts the bytes after the header
+struct frame_header{
+  uint16_t magic, w, h;
+  uint32_t total;
+};
+// 3 byte bgr pixels
+constexpr uint16_t color_frame = 0xADDE;
+// worker to compositor: the 32 bit big endian frame id, then 3 byte bgr
+// pixels followed by native float window depth. the id is that of the last
+// input batch the worker had read when it rendered the frame, so frames of
+// all workers with the same id show the same camera
+constexpr uint16_t depth_frame = 0xADDF;
+// sent after a color frame to viewers that asked for it: the 16 floats of
+// the column major view-projection matrix, then window depth as 16 bit
+// integers
+constexpr uint16_t reprojection_frame = 0xADE0;
+// the subscribed region of interest: x and y as 16 bit, then its pixels
+constexpr uint16_t roi_frame = 0xADE1;
+// the view downscaled to the subscribed thumbnail size
+constexpr uint16_t thumbnail_frame = 0xADE2;
+
+// the largest width, height or offset a header or roi origin carries
+constexpr unsigned max_extent = 0xffff;
+
+inline frame_header make_header(uint16_t magic, glm::uvec2 size, size_t total){
+  return {
+    .magic = magic,
+    .w = std::byteswap((uint16_t) size.x),
+    .h = std::byteswap((uint16_t) size.y),
+    .total = std::byteswap((uint32_t) total)
+  };
+}
+
+// viewer to server, 16 bytes, every field big endian.
+// region_of_interest: x, y and width << 16 | height in the pixels of the
+// full frame, an empty region unsubscribes. thumbnail: width, height and
+// frames per second at most, width 0 unsubscribes. full_frames: 0 stops
+// the full frame stream, anything else resumes it. worker_index: sent by a
+// compositor to each worker first, its index and the number of workers.
+// frame_id: sent by a compositor after each batch of forwarded input, the
+// id of the batch
+enum class input_type : uint32_t {
+  resize,
+  mouse_click,
+  mouse_down,
+  mouse_up,
+  mouse_wheel,
+  scroll,
+  mouse_drag,
+  mouse_move,
+  reprojection,
+  region_of_interest,
+  thumbnail,
+  full_frames,
+  worker_index,
+  frame_id
+};
+struct input_message{
+  glm::ivec3 data;
+  input_type t;
+};
+
+// to native byte order in place
+inline void decode(input_message& msg){
+  msg.data.x = std::byteswap(msg.data.x);
+  msg.data.y = std::byteswap(msg.data.y);
+  msg.data.z = std::byteswap(msg.data.z);
+  msg.t = (input_type) std::byteswap(std::to_underlying(msg.t));
+}
+inline void encode(input_message& msg){
+  decode(msg);
+}
+}
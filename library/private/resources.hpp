@@ -0,0 +1,13 @@
+#pragma once
+#include <string_view>
+
+#include <cmrc/cmrc.hpp>
+
+CMRC_DECLARE(visualizer_plugin);
+
+namespace plugin::impl {
+inline std::string_view get_file(const char* path){
+  auto file = cmrc::visualizer_plugin::get_filesystem().open(path);
+  return {file.begin(), file.end()};
+}
+}
@@ -0,0 +1,162 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace plugin::impl::snapshot {
+// header, then the value records, the program records and the blob
+// records. every record starts 8 byte aligned so the file can be used in
+// place once mapped, blobs are uploaded straight from the mapping
+constexpr char magic[8] = {'v', 'i', 's', 'p', 's', 'n', 'a', 'p'};
+constexpr uint32_t version = 2;
+
+struct header{
+  char magic[8];
+  uint32_t version;
+  uint32_t values;
+  uint32_t programs;
+  uint32_t blobs;
+};
+// values: key is unused and name is the type name. programs: key is the
+// program cache key, format the binary format and there is no name. blobs:
+// key is the index of their value, in the order the renderer kept them, and
+// there is no name
+struct record{
+  uint64_t key;
+  uint64_t size;
+  uint32_t name_size;
+  uint32_t format;
+};
+
+struct value{
+  std::string type;
+  std::vector<std::byte> data;
+  // what the renderer derived from the value for the gpu
+  std::vector<std::vector<std::byte>> blobs;
+};
+enum class kind{
+  value,
+  program,
+  blob
+};
+struct program{
+  uint64_t key;
+  uint32_t format;
+  std::span<const char> data;
+};
+
+inline size_t padded(size_t n){ return (n + 7) & ~size_t(7); }
+
+// written next to the target and renamed over it, a crash never leaves a
+// torn snapshot behind
+inline void write(
+  const std::filesystem::path& path,
+  std::span<const value> values,
+  std::span<const program> programs
+){
+  auto temporary = path;
+  temporary += ".tmp";
+  {
+    std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+    if(!file)
+      throw std::runtime_error("cannot write snapshot " + temporary.string());
+    uint32_t blobs = 0;
+    for(auto& v:values)
+      blobs += v.blobs.size();
+    header h{{}, version, (uint32_t)values.size(), (uint32_t)programs.size(), blobs};
+    std::memcpy(h.magic, magic, sizeof magic);
+    file.write((const char*)&h, sizeof h);
+    auto put = [&](record r, std::string_view name, const void* data){
+      static constexpr char zeros[8]{};
+      file.write((const char*)&r, sizeof r);
+      file.write(name.data(), name.size());
+      file.write(zeros, padded(name.size()) - name.size());
+      file.write((const char*)data, r.size);
+      file.write(zeros, padded(r.size) - r.size);
+    };
+    for(auto& v:values)
+      put({0, v.data.size(), (uint32_t)v.type.size(), 0}, v.type, v.data.data());
+    for(auto& p:programs)
+      put({p.key, p.data.size(), 0, p.format}, {}, p.data.data());
+    for(size_t i = 0; i < values.size(); ++i)
+      for(auto& b:values[i].blobs)
+        put({i, b.size(), 0, 0}, {}, b.data());
+    if(!file.flush())
+      throw std::runtime_error("cannot write snapshot " + temporary.string());
+  }
+  std::filesystem::rename(temporary, path);
+}
+
+// a read-only mapping of a snapshot; records point into it
+struct mapping{
+  explicit mapping(const std::filesystem::path& path){
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if(fd < 0)
+      throw std::system_error(errno, std::generic_category(), path.string());
+    struct stat st{};
+    if(fstat(fd, &st) == 0 && st.st_size)
+      data = mmap(nullptr, size = st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if(data == MAP_FAILED || !data)
+      throw std::runtime_error("cannot map snapshot " + path.string());
+    madvise(data, size, MADV_SEQUENTIAL);
+    try {
+      if(size < sizeof(header))
+        throw std::runtime_error("snapshot too short");
+      std::memcpy(&h, data, sizeof h);
+      if(std::memcmp(h.magic, magic, sizeof magic))
+        throw std::runtime_error("not a snapshot: " + path.string());
+      if(h.version != version)
+        throw std::runtime_error("snapshot version " + std::to_string(h.version) + ", expected " + std::to_string(version));
+    }
+    catch(...){
+      munmap(data, size);
+      throw;
+    }
+  }
+  mapping(const mapping&) = delete;
+  ~mapping(){
+    if(data && data != MAP_FAILED)
+      munmap(data, size);
+  }
+  std::span<const std::byte> bytes() const{ return {(const std::byte*)data, size}; }
+
+  // f(kind, record, name, data) for every record; throws on a truncated
+  // file
+  template<class F>
+  void each(F&& f) const{
+    auto rest = bytes().subspan(sizeof(header));
+    for(size_t i = 0; i < size_t(h.values) + h.programs + h.blobs; ++i){
+      record r;
+      if(rest.size() < sizeof r)
+        throw std::runtime_error("truncated snapshot");
+      std::memcpy(&r, rest.data(), sizeof r);
+      rest = rest.subspan(sizeof r);
+      if(padded(r.name_size) > rest.size() || padded(r.size) > rest.size() - padded(r.name_size))
+        throw std::runtime_error("truncated snapshot");
+      std::string_view name((const char*)rest.data(), r.name_size);
+      auto payload = rest.subspan(padded(r.name_size), r.size);
+      rest = rest.subspan(padded(r.name_size) + padded(r.size));
+      f(i < h.values ? kind::value : i < size_t(h.values) + h.programs ? kind::program : kind::blob, r, name, payload);
+    }
+  }
+  header h{};
+private:
+  void* data = nullptr;
+  size_t size = 0;
+};
+}
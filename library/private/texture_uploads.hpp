@@ -0,0 +1,220 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <utility>
+#include <vector>
+
+#include "visualizer-plugin/visualizer-plugin.hpp"
+#include "visualizer-plugin/abstraction/gl.hpp"
+
+namespace plugin {
+// two textures: renderers sample the front one while the loader writes the
+// back one, which becomes the front once its fence passed. the back one
+// first catches up on the regions of the batch before, so each is at most
+// one batch behind the other
+struct streamed_texture::state{
+  struct request{
+    gl::ubox2 region;
+    unsigned format, type;
+    size_t bytes;
+    std::function<void(std::span<std::byte>)> fill;
+  };
+  glm::uvec2 size;
+  unsigned format;
+  int levels;
+  // what the textures are charged to
+  unsigned owner = 0;
+  std::mutex m;
+  // written under the lock by any thread, taken by the loader
+  std::vector<request> queued;
+  // written under the lock by the render thread
+  int front = -1;
+  // the render thread stopped using the old front once this passed
+  GLsync released = nullptr;
+  // the batch in flight, back is written by the loader
+  GLsync uploaded = nullptr;
+  int back = 0;
+  // loader only
+  std::array<gl::texture, 2> textures;
+  std::array<bool, 2> filled{};
+  std::vector<gl::ubox2> behind;
+
+  ~state(){
+    if(released)
+      glDeleteSync(released);
+    if(uploaded)
+      glDeleteSync(uploaded);
+  }
+};
+
+namespace impl {
+inline bool signalled(GLsync fence){
+  auto status = glClientWaitSync(fence, 0, 0);
+  return status == GL_ALREADY_SIGNALED || status == GL_CONDITION_SATISFIED;
+}
+
+// streamed textures known to the core; process() runs on the loader thread,
+// publish() on the render thread
+struct texture_uploads{
+  // a persistently mapped unpack buffer, reused once the gpu read it
+  struct staging{
+    static constexpr unsigned flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+    staging(size_t bytes):
+      pbo(bytes, flags),
+      memory((std::byte*)glMapNamedBufferRange(pbo.native(), 0, bytes, flags))
+    {}
+    ~staging(){
+      if(fence)
+        glDeleteSync(fence);
+    }
+    bool idle(){
+      if(fence && signalled(fence))
+        glDeleteSync(std::exchange(fence, nullptr));
+      return !fence;
+    }
+    gl::buffer<std::byte> pbo;
+    std::byte* memory;
+    GLsync fence = nullptr;
+    // order of the batches, the smallest is the oldest in flight
+    uint64_t serial = 0;
+  };
+  static constexpr size_t staging_capacity = 4;
+  static constexpr size_t min_staging_size = 1 << 22;
+
+  void add(std::shared_ptr<streamed_texture::state> t){
+    std::lock_guard lock(m);
+    textures.push_back(std::move(t));
+  }
+
+  void process(){
+    std::vector<std::shared_ptr<streamed_texture::state>> work;
+    {
+      std::lock_guard lock(m);
+      // nothing but this list holds textures whose owner is gone
+      std::erase_if(textures, [](auto& t){ return t.use_count() == 1; });
+      work = textures;
+    }
+    for(auto& t:work)
+      upload(*t);
+  }
+
+  // swaps textures whose batch arrived; true if one of them has more writes
+  // queued for the loader
+  bool publish(){
+    std::lock_guard lock(m);
+    bool swapped = false, waiting = false;
+    for(auto& t:textures){
+      std::lock_guard texture_lock(t->m);
+      if(!t->uploaded || !signalled(t->uploaded))
+        continue;
+      glDeleteSync(std::exchange(t->uploaded, nullptr));
+      t->front = t->back;
+      t->released = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+      swapped = true;
+      waiting |= !t->queued.empty();
+    }
+    // the loader waits on the fences on the gpu
+    if(swapped)
+      glFlush();
+    return waiting;
+  }
+
+private:
+  void upload(streamed_texture::state& t){
+    std::vector<streamed_texture::state::request> batch;
+    int front;
+    GLsync released;
+    {
+      std::lock_guard lock(t.m);
+      if(t.uploaded || t.queued.empty())
+        return;
+      batch.swap(t.queued);
+      front = t.front;
+      released = std::exchange(t.released, nullptr);
+    }
+    gl::memory::scope charge{t.owner};
+    if(!t.textures[0])
+      for(auto& x:t.textures){
+        x = gl::texture(t.size, t.format, t.levels);
+        x.filter(t.levels > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR, GL_LINEAR);
+      }
+    if(released){
+      glWaitSync(released, 0, GL_TIMEOUT_IGNORED);
+      glDeleteSync(released);
+    }
+    auto back = front < 0 ? 0 : 1 - front;
+    auto& dst = t.textures[back];
+    if(front >= 0 && !t.filled[back])
+      dst.copy(t.textures[front], 0, {{}, t.size});
+    else if(front >= 0)
+      for(auto& r:t.behind)
+        dst.copy(t.textures[front], 0, r);
+    t.filled[back] = true;
+
+    auto aligned = [](size_t n){ return (n + 15) & ~size_t(15); };
+    size_t total = 0;
+    for(auto& r:batch)
+      total += aligned(r.bytes);
+    auto& s = acquire(total);
+    t.behind.clear();
+    size_t offset = 0;
+    for(auto& r:batch){
+      try {
+        r.fill({s.memory + offset, r.bytes});
+        dst.write(0, r.region, r.format, r.type, s.pbo, offset);
+        t.behind.push_back(r.region);
+      }
+      catch(std::exception& e){
+        std::cerr << "failed to fill texture upload: " << e.what() << "\n";
+      }
+      offset += aligned(r.bytes);
+    }
+    if(t.levels > 1)
+      dst.generate_mipmaps();
+    s.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    s.serial = ++batches;
+    auto fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    glFlush();
+    std::lock_guard lock(t.m);
+    t.back = back;
+    t.uploaded = fence;
+  }
+
+  // never holds more than staging_capacity buffers: idle ones make room
+  // first, then the loader waits for the oldest batch in flight
+  staging& acquire(size_t bytes){
+    for(auto& s:pool)
+      if(s->pbo.size() >= bytes && s->idle())
+        return *s;
+    for(auto it = pool.begin(); pool.size() >= staging_capacity && it != pool.end();)
+      it = (*it)->idle() ? pool.erase(it) : it + 1;
+    while(pool.size() >= staging_capacity){
+      auto oldest = std::ranges::min_element(pool, {}, [](auto& s){ return s->serial; });
+      auto& s = **oldest;
+      for(;;){
+        auto status = glClientWaitSync(s.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1'000'000);
+        if(status != GL_TIMEOUT_EXPIRED)
+          break;
+      }
+      glDeleteSync(std::exchange(s.fence, nullptr));
+      if(s.pbo.size() >= bytes)
+        return s;
+      pool.erase(oldest);
+    }
+    // staging belongs to the core, not to the texture it is acquired for
+    gl::memory::scope charge{0};
+    return *pool.emplace_back(std::make_unique<staging>(std::max(bytes, min_staging_size)));
+  }
+
+  std::mutex m;
+  std::vector<std::shared_ptr<streamed_texture::state>> textures;
+  std::vector<std::unique_ptr<staging>> pool;
+  uint64_t batches = 0;
+};
+}
+}
@@ -0,0 +1,111 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace plugin::impl {
+// fork-join pool for per-frame loops. workers and the calling thread claim
+// chunks from one shared cursor, so whoever is idle takes the next chunk;
+// for flat loops that balances like work stealing without per-thread
+// queues
+struct thread_pool{
+  explicit thread_pool(unsigned n = std::max(std::thread::hardware_concurrency(), 2u) - 1){
+    for(unsigned i = 0; i < n; ++i)
+      threads.emplace_back([this](std::stop_token stop){ work(stop); });
+  }
+  ~thread_pool(){
+    for(auto& t:threads)
+      t.request_stop();
+    {
+      std::lock_guard lock(m);
+      ++generation;
+    }
+    start.notify_all();
+  }
+  thread_pool(const thread_pool&) = delete;
+
+  size_t size() const { return threads.size() + 1; }
+
+  // calls f(i) for i in [0, n) and returns when all calls have; the first
+  // exception thrown by f is rethrown here
+  void parallel_for(size_t n, const std::function<void(size_t)>& f, size_t chunk = 1){
+    if(!n)
+      return;
+    if(n <= chunk || threads.empty()){
+      for(size_t i = 0; i < n; ++i)
+        f(i);
+      return;
+    }
+    {
+      std::lock_guard lock(m);
+      job = &f;
+      count = n;
+      grain = chunk;
+      cursor.store(0, std::memory_order_relaxed);
+      error = nullptr;
+      busy = threads.size();
+      ++generation;
+    }
+    start.notify_all();
+    run();
+    std::unique_lock lock(m);
+    done.wait(lock, [&]{ return busy == 0; });
+    job = nullptr;
+    if(error)
+      std::rethrow_exception(std::exchange(error, nullptr));
+  }
+
+private:
+  void run(){
+    for(;;){
+      auto begin = cursor.fetch_add(grain, std::memory_order_relaxed);
+      if(begin >= count)
+        return;
+      try {
+        for(auto i = begin; i < std::min(begin + grain, count); ++i)
+          (*job)(i);
+      }
+      catch(...){
+        std::lock_guard lock(m);
+        if(!error)
+          error = std::current_exception();
+        cursor.store(count, std::memory_order_relaxed);
+      }
+    }
+  }
+  void work(std::stop_token stop){
+    uint64_t seen = 0;
+    for(;;){
+      {
+        std::unique_lock lock(m);
+        start.wait(lock, [&]{ return generation != seen; });
+        seen = generation;
+        if(stop.stop_requested())
+          return;
+      }
+      run();
+      std::lock_guard lock(m);
+      if(--busy == 0)
+        done.notify_one();
+    }
+  }
+
+  std::mutex m;
+  std::condition_variable start, done;
+  const std::function<void(size_t)>* job = nullptr;
+  size_t count = 0, grain = 1;
+  std::atomic<size_t> cursor = 0;
+  std::exception_ptr error;
+  size_t busy = 0;
+  uint64_t generation = 0;
+  std::vector<std::jthread> threads;
+};
+}
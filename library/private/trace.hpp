@@ -0,0 +1,224 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <vector>
+
+#include <GL/glew.h>
+#include <unistd.h>
+
+namespace plugin::impl::trace {
+// coroutines interleave on one thread, so spans go to logical tracks that
+// show up as separate threads in the trace viewer
+enum class track : uint32_t {
+  render = 1,
+  sender,
+  input,
+  loader,
+  gpu,
+  // samples of counters rather than spans
+  counters
+};
+
+struct event{
+  const char* name;
+  int64_t begin;
+  int64_t end;
+  uint64_t arg;
+  track t;
+  // tells apart the series of a counter, or what a span worked on
+  uint32_t id = 0;
+};
+
+inline int64_t now(){
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+    std::chrono::steady_clock::now().time_since_epoch()
+  ).count();
+}
+
+// written by its own thread only; the dump copies it without stopping the
+// writer. every slot is a seqlock: its sequence is odd while the writer is
+// in it and tells which event it holds, so a copy that raced with the
+// writer or found a newer event is dropped
+struct ring{
+  static constexpr size_t capacity = 1 << 16;
+  static constexpr size_t words = sizeof(event) / sizeof(uint64_t);
+  static_assert(sizeof(event) % sizeof(uint64_t) == 0);
+  struct slot{
+    std::atomic<size_t> sequence{0};
+    std::array<std::atomic<uint64_t>, words> data;
+  };
+  void push(const event& e){
+    auto h = head.load(std::memory_order_relaxed);
+    auto& s = slots[h % capacity];
+    auto w = std::bit_cast<std::array<uint64_t, words>>(e);
+    s.sequence.store(2 * h + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    for(size_t i = 0; i < words; ++i)
+      s.data[i].store(w[i], std::memory_order_relaxed);
+    s.sequence.store(2 * h + 2, std::memory_order_release);
+    head.store(h + 1, std::memory_order_release);
+  }
+  std::vector<event> snapshot() const{
+    auto end = head.load(std::memory_order_acquire);
+    auto begin = end > capacity ? end - capacity : 0;
+    std::vector<event> r;
+    r.reserve(end - begin);
+    for(auto i = begin; i < end; ++i){
+      auto& s = slots[i % capacity];
+      auto sequence = s.sequence.load(std::memory_order_acquire);
+      if(sequence != 2 * i + 2)
+        continue;
+      std::array<uint64_t, words> w;
+      for(size_t j = 0; j < words; ++j)
+        w[j] = s.data[j].load(std::memory_order_relaxed);
+      std::atomic_thread_fence(std::memory_order_acquire);
+      if(s.sequence.load(std::memory_order_relaxed) != sequence)
+        continue;
+      r.push_back(std::bit_cast<event>(w));
+    }
+    return r;
+  }
+  std::array<slot, capacity> slots;
+  std::atomic<size_t> head{0};
+};
+
+struct recorder{
+  static recorder& get(){
+    static recorder r;
+    return r;
+  }
+  bool enabled() const{
+    return on.load(std::memory_order_relaxed);
+  }
+  void enable(bool b){
+    on.store(b, std::memory_order_relaxed);
+  }
+  void record(const event& e){
+    thread_local ring* local = [&]{
+      std::lock_guard lock(m);
+      return rings.emplace_back(std::make_unique<ring>()).get();
+    }();
+    local->push(e);
+  }
+  void dump(std::ostream& out){
+    std::vector<event> events;
+    {
+      std::lock_guard lock(m);
+      for(auto& r:rings){
+        auto part = r->snapshot();
+        events.insert(events.end(), part.begin(), part.end());
+      }
+    }
+    auto pid = getpid();
+    const char* track_names[]{"", "render", "sender", "input", "loader", "gpu", "counters"};
+    out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+    for(uint32_t t = 1; t < std::size(track_names); ++t)
+      out << (t > 1 ? "," : "")
+        << "{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":" << pid << ",\"tid\":" << t
+        << ",\"args\":{\"name\":\"" << track_names[t] << "\"}}";
+    for(auto& e:events)
+      if(e.t == track::counters)
+        out << ",{\"ph\":\"C\",\"name\":\"" << e.name << "\",\"id\":" << e.id
+          << ",\"pid\":" << pid << ",\"ts\":" << e.begin / 1000.
+          << ",\"args\":{\"value\":" << e.arg << "}}";
+      else
+        out << ",{\"ph\":\"X\",\"name\":\"" << e.name << "\",\"pid\":" << pid
+          << ",\"tid\":" << (uint32_t)e.t
+          << ",\"ts\":" << e.begin / 1000. << ",\"dur\":" << (e.end - e.begin) / 1000.
+          << ",\"args\":{\"arg\":" << e.arg << ",\"id\":" << e.id << "}}";
+    out << "]}\n";
+  }
+  void dump(const char* path){
+    std::ofstream out(path);
+    dump(out);
+  }
+private:
+  std::atomic<bool> on{false};
+  std::mutex m;
+  std::vector<std::unique_ptr<ring>> rings;
+};
+
+// one sample of the series id of a counter
+inline void count(const char* name, uint32_t id, uint64_t value){
+  if(recorder::get().enabled())
+    recorder::get().record({name, now(), 0, value, track::counters, id});
+}
+
+struct span{
+  span(const char* name, track t, uint64_t arg = 0, uint32_t id = 0):
+    name(name),
+    t(t),
+    arg(arg),
+    id(id),
+    begin(recorder::get().enabled() ? now() : 0){}
+  ~span(){
+    if(begin)
+      recorder::get().record({name, begin, now(), arg, t, id});
+  }
+  span(const span&) = delete;
+  const char* name;
+  track t;
+  uint64_t arg;
+  uint32_t id;
+  int64_t begin;
+};
+
+// GPU timestamps of a frame, read back a few frames later without stalling
+// and moved onto the CPU clock with an offset measured once
+struct gpu_timer{
+  static constexpr size_t frames = 4;
+  static constexpr size_t marks = 3;
+  // tracing is sampled once per frame at mark(0), the other marks follow
+  // it; end_frame only reads frames whose every mark was issued
+  void mark(size_t i){
+    if(i == 0){
+      recording = recorder::get().enabled();
+      issued[frame % frames] = 0;
+    }
+    if(!recording)
+      return;
+    if(!queries[0][0]){
+      glCreateQueries(GL_TIMESTAMP, frames * marks, &queries[0][0]);
+      GLint64 gpu_now = 0;
+      glGetInteger64v(GL_TIMESTAMP, &gpu_now);
+      offset = now() - gpu_now;
+    }
+    glQueryCounter(queries[frame % frames][i], GL_TIMESTAMP);
+    issued[frame % frames] |= 1u << i;
+  }
+  void end_frame(){
+    recording = false;
+    if(!queries[0][0])
+      return;
+    ++frame;
+    auto& q = queries[frame % frames];
+    if(issued[frame % frames] != (1u << marks) - 1)
+      return;
+    GLint available = 0;
+    glGetQueryObjectiv(q[marks - 1], GL_QUERY_RESULT_AVAILABLE, &available);
+    if(!available)
+      return;
+    issued[frame % frames] = 0;
+    GLuint64 t[marks];
+    for(size_t i = 0; i < marks; ++i)
+      glGetQueryObjectui64v(q[i], GL_QUERY_RESULT, &t[i]);
+    const char* names[]{"gpu draw", "gpu resolve+readback"};
+    for(size_t i = 0; i + 1 < marks; ++i)
+      recorder::get().record({names[i], (int64_t)t[i] + offset, (int64_t)t[i + 1] + offset, frame, track::gpu});
+  }
+  GLuint queries[frames][marks]{};
+  // a bit per mark issued in the frame
+  unsigned issued[frames]{};
+  bool recording = false;
+  int64_t offset = 0;
+  size_t frame = 0;
+};
+}
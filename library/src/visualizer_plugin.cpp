@@ -1,14 +1,28 @@
+#include <algorithm>
 #include <atomic>
 #include <bit>
+#include <chrono>
 #include <cmath>
+#include <csignal>
+#include <cstdlib>
 #include <fstream>
+#include <functional>
 #include <iostream>
+#include <limits>
+#include <list>
 #include <memory>
+#include <mutex>
+#include <numeric>
+#include <optional>
 #include <ranges>
+#include <semaphore>
+#include <span>
 #include <stdexcept>
 #include <string>
 #include <thread>
+#include <tuple>
 #include <type_traits>
+#include <unordered_map>
 #include <vector>
 
 #define GLM_FORCE_SWIZZLE
@@ -21,12 +35,22 @@
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtx/transform.hpp>
 
-#include <dlfcn.h>
-
 #include "visualizer-plugin/abstraction/gl.hpp"
 #include "visualizer-plugin/abstraction/glfw.hpp"
 #include "plane_renderer.hpp"
 #include "main_framebuffer.hpp"
+#include "camera.hpp"
+#include "compositor.hpp"
+#include "constructor_queue.hpp"
+#include "frame_pipeline.hpp"
+#include "link_monitor.hpp"
+#include "plugin_registry.hpp"
+#include "snapshot.hpp"
+#include "trace.hpp"
+#include "thread_pool.hpp"
+#include "depth_quantize.hpp"
+#include "gpu_culling.hpp"
+#include "texture_uploads.hpp"
 #include "visualizer-plugin/visualizer-plugin.hpp"
 
 namespace asio = boost::asio;
@@ -37,56 +61,6 @@ using namespace asio::experimental::awaitable_operators;
 
 namespace plugin {
 
-struct renderer_context::pimpl {
-  glm::uvec2 res;
-  glm::vec2 dir = {};
-  glm::vec3 lookat = {};
-  glm::vec3 camera_pos = {};
-  glm::vec3 cursor_pos = {};
-  float zoom = 1;
-  float logzoom = 1;
-  glm::ivec2 mouse_pos = res / 2u;
-  struct mouse_button_bits {
-    bool left :1;
-    bool middle :1;
-    bool right :1;
-  } mouse_buttons;
-  
-  auto calculate_view() const  {
-    return glm::lookAt(camera_pos, lookat, {0., 1., 0.});
-  }
-  
-  auto calculate_proj() const  {
-    return glm::perspective(
-      glm::radians(90.f),
-      (float) res.x / (float) res.y,
-      0.01f * zoom,
-      1000.f * zoom
-    );
-  }
-  
-  auto calculate_matrix() const  {
-    auto project = glm::perspective(
-      glm::radians(90.f),
-      (float) res.x / (float) res.y,
-      0.01f * zoom,
-      1000.f * zoom
-    );
-    auto view = glm::lookAt(camera_pos, lookat, {0., 1., 0.});
-    return project * view;
-  }
-  
-  void calculate_zoom() { zoom = std::exp(logzoom); }
-  
-  void calculate_camera_pos() {
-    camera_pos = lookat + zoom * glm::vec3{
-      4. * std::sin(dir.x) * std::cos(dir.y),
-      -4. * std::sin(dir.y),
-      4. * std::cos(dir.x) * std::cos(dir.y)
-    };
-  }
-};
-
 glm::uvec2 renderer_context::resolution() const { return impl.res; }
 
 glm::vec3 renderer_context::position() const { return impl.camera_pos; }
@@ -95,42 +69,131 @@ glm::vec3 renderer_context::focus() const { return impl.lookat; }
 
 float renderer_context::camera_scale() const { return impl.zoom; }
 
-glm::mat4 renderer_context::matrix() const { return impl.calculate_matrix(); }
+glm::mat4 renderer_context::matrix() const { return impl.frame_matrix; }
 
 namespace impl {
 struct plane_type;
+
+// bytes, 0 for none
+std::atomic<size_t> gpu_budget = [] {
+  auto env = std::getenv("VISUALIZER_GPU_BUDGET");
+  return env ? (size_t) std::strtoull(env, nullptr, 10) << 20 : 0;
+}();
+std::atomic<int> frame_samples{main_framebuffer::max_samples};
+// frames in flight per view, 0 for automatic
+std::atomic<unsigned> frames_in_flight = [] {
+  auto env = std::getenv("VISUALIZER_FRAMES_IN_FLIGHT");
+  return env ? (unsigned) std::strtoul(env, nullptr, 10) : 0u;
+}();
+// names of the owners of gpu memory, renderers are named by the loader
+std::mutex owners_mutex;
+std::unordered_map<unsigned, std::string> owner_names{{0, "core"}};
+// the type the loader constructs a renderer for
+thread_local std::string constructing;
 }
 
 struct render_core {
-  std::vector<std::unique_ptr<renderer_base>> opaque_renderers;
-  std::vector<std::unique_ptr<renderer_base>> transparent_renderers;
-  static boost::lockfree::spsc_queue<std::function<renderer_base *()>>
-    constructor_queue;
+  std::vector<std::unique_ptr<renderer_base>> renderers;
+  // what gpu memory of each renderer is charged to
+  std::vector<unsigned> owners;
+  // whether the view being drawn shows the core's own renderers, the
+  // transparent plane; of all workers only the first does, so that the
+  // merged frame blends it once
+  bool core_items = true;
+  // renderers whose update threw for the view being drawn, one flag each
+  // written by whichever worker ran it, and their owners
+  std::vector<char> update_failed;
+  std::vector<unsigned> failed_owners;
+  // frames before renderers are asked to release or restore memory again
+  static constexpr unsigned renderer_interval = 60;
+  unsigned renderer_cooldown = 0;
+  render_queue scene;
+  static impl::constructor_queue constructor_queue;
+  static std::counting_semaphore<> constructor_signal;
+  struct constructed {
+    renderer_base *r;
+    GLsync fence;
+    unsigned owner;
+  };
+  boost::lockfree::spsc_queue<constructed> ready_queue{1024};
+  std::vector<constructed> pending;
+  // loader only
+  unsigned last_owner = 0;
   
   render_core(render_core &&) = delete;
   
   render_core(const render_core &) = delete;
   
   boost::asio::io_context ctx;
-  // struct frame_data {
-  //   gl::buffer<glm::tvec3<char>> memory;
-  //   gl::buffer<float> depth;
-  //   glm::uvec2 size{};
-  // };
-  plugin::renderer_context::pimpl render_data;
-  // concurrent_channel<void(boost::system::error_code, frame_data)>
-  //   render_to_sender;
-  // concurrent_channel<void(boost::system::error_code, frame_data)>
-  //   sender_to_render;
-  concurrent_channel<void(boost::system::error_code, impl::main_framebuffer::client_memory)>
-    render_to_sender;
-  concurrent_channel<void(boost::system::error_code, impl::main_framebuffer::client_memory)>
-    sender_to_render;
+  using client_memory = impl::main_framebuffer::client_memory;
+  // one readback of the atlas is shared by every view that shows it
+  struct view_frame {
+    // a stream sent with the frame: the part of the readback holding it and
+    // its rect in the view, or the size of a thumbnail
+    struct stream {
+      size_t part;
+      gl::ubox2 rect;
+    };
+    std::shared_ptr<client_memory> memory;
+    glm::mat4 matrix;
+    // the input batch of a worker it was rendered after
+    uint32_t id = 0;
+    std::optional<stream> full, roi, thumbnail;
+  };
+  struct view {
+    view(asio::io_context &ctx, plugin::projection p, bool worker) :
+      socket(ctx),
+      mailbox(ctx, impl::frame_pipeline::max_depth),
+      worker(worker) { camera.projection = p; }
+    renderer_context::pimpl camera{
+      {500, 500},
+      {1,   0.5}
+    };
+    renderer_context::pimpl frame_state = camera;
+    gl::ubox2 rect{};
+    asio::ip::tcp::socket socket;
+    concurrent_channel<void(boost::system::error_code, view_frame)> mailbox;
+    impl::link_monitor link;
+    // frames published and not yet sent, at most depth of them
+    impl::frame_pipeline pipeline;
+    unsigned in_flight = 0;
+    unsigned depth = 1;
+    bool connected = false;
+    // has a rect in the framebuffer this frame
+    bool placed = false;
+    // streams color and depth to a compositor instead of a viewer; the
+    // compositor numbers its input batches and tells each worker its index
+    bool worker;
+    uint32_t frame_id = 0;
+    int worker_index = 0;
+    // the viewer asked for matrix and depth of every frame to reproject it
+    bool reproject = false;
+    std::vector<uint16_t> depth_plane;
+    // streams the viewer subscribed to, the region of interest in view
+    // pixels
+    bool full_frames = true;
+    gl::ubox2 roi{};
+    glm::uvec2 thumbnail_size{};
+    impl::link_monitor::clock::duration thumbnail_interval{};
+    impl::link_monitor::clock::time_point next_thumbnail{};
+    view_frame next;
+  };
+  std::list<view> views;
+  // cancelled whenever a view finishes a frame or goes away
+  asio::steady_timer frame_done{ctx};
+  std::vector<std::shared_ptr<client_memory>> frames;
   glfw::window window;
-  std::string ip;
-  uint32_t port;
+  glfw::window loader_window;
+  std::jthread loader;
+  bool depth_wanted = false;
+  impl::trace::gpu_timer gpu_timer;
+  impl::thread_pool pool;
+  // created with the first gpu object
+  std::unique_ptr<impl::gpu_culling> culling;
+  impl::texture_uploads uploads;
+  std::string trace_path = "visualizer-trace.json";
   
-  render_core(const char *ip, uint32_t port) :
+  render_core() :
     window{
       glfw::window_builder{}
         .size(
@@ -142,14 +205,14 @@ struct render_core {
         .visible(false)
         .build()
     },
-    render_data{
-      {500, 500},
-      {1,   0.5}
-    },
-    render_to_sender(ctx, 2),
-    sender_to_render(ctx, 1),
-    ip(ip),
-    port(port) {}
+    loader_window{
+      glfw::window_builder{}
+        .size({1, 1})
+        .api(glfw::window_api::gl)
+        .visible(false)
+        .share(window)
+        .build()
+    } {}
   
   auto setup_gl() {
     window.make_current();
@@ -158,47 +221,262 @@ struct render_core {
     if(err != GLEW_OK)
       throw std::runtime_error{(const char *) glewGetErrorString(err)};
     
-    using ec = boost::system::error_code;
-    sender_to_render.try_send(
-      ec{},
-      impl::main_framebuffer::client_memory{.color_image = {{}}, .depth_image = {{}}, .size = {}}
-    );
-    sender_to_render.try_send(
-      ec{},
-      impl::main_framebuffer::client_memory{.color_image = {{}}, .depth_image = {{}}, .size = {}}
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    join((renderer_base *) new renderer<impl::plane_type>);
+  }
+  
+  // compiles shaders and uploads meshes on a context shared with the render
+  // thread; a renderer is handed over with a fence that tells when the GPU
+  // side of its construction is complete
+  void load(std::stop_token stop) {
+    loader_window.make_current();
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    while(!stop.stop_requested()) {
+      // texture writes signal too
+      auto signalled = constructor_signal.try_acquire_for(std::chrono::milliseconds(100));
+      uploads.process();
+      if(!signalled)
+        continue;
+      std::function<renderer_base *()> elem;
+      if(!constructor_queue.pop(elem))
+        continue;
+      try {
+        impl::trace::span span{"construct", impl::trace::track::loader};
+        auto owner = ++last_owner;
+        renderer_base *r;
+        {
+          gl::memory::scope charge{owner};
+          r = elem();
+        }
+        {
+          std::lock_guard lock(impl::owners_mutex);
+          impl::owner_names[owner] = "#" + std::to_string(owner) + " " + std::exchange(impl::constructing, {});
+        }
+        auto fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        glFlush();
+        while(!ready_queue.push({r, fence, owner}))
+          std::this_thread::yield();
+      }
+      catch(std::exception &e) {
+        std::cerr << "failed to construct renderer: " << e.what() << "\n";
+      }
+      catch(...) {
+        std::cerr << "failed to construct renderer: unknown error\n";
+      }
+    }
+  }
+  
+  void join_ready() {
+    ready_queue.consume_all([&](constructed c) { pending.push_back(c); });
+    std::erase_if(pending, [&](constructed &c) {
+      auto status = glClientWaitSync(c.fence, 0, 0);
+      if(status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+        return false;
+      glDeleteSync(c.fence);
+      join(c.r, c.owner);
+      return true;
+    });
+  }
+  
+  void join(renderer_base *r, unsigned owner = 0) {
+    renderers.emplace_back(r);
+    owners.push_back(owner);
+    auto first = scene.items.size();
+    r->submit(scene);
+    for(auto &x:std::span(scene.items).subspan(first))
+      x.owner = owner;
+  }
+  
+  void sort_scene() {
+    if(scene.sorted)
+      return;
+    // transparent items keep submission order, blending depends on it
+    std::ranges::stable_sort(scene.items, {}, [](const draw_item &x) {
+      if(x.pass == render_pass::transparent)
+        return std::tuple{x.pass, 0u, 0u, 0u};
+      return std::tuple{x.pass, x.program, x.vao, x.texture};
+    });
+    scene.sorted = true;
+  }
+  
+  void upload_objects() {
+    if(!scene.objects_changed)
+      return;
+    if(!culling)
+      culling = std::make_unique<impl::gpu_culling>();
+    culling->set(scene.objects);
+    scene.objects_changed = false;
+  }
+  
+  void draw(render_pass pass, renderer_context::pimpl &state) {
+    auto [first, last] = std::ranges::equal_range(
+      scene.items, pass, {}, &draw_item::pass
     );
-    transparent_renderers
-      .emplace_back((renderer_base *) new renderer<impl::plane_type>);
+    auto &gl_state = gl::state::current();
+    unsigned texture = gl::state::unknown;
+    for(auto &x:std::ranges::subrange(first, last)) {
+      if(!failed_owners.empty() && std::ranges::binary_search(failed_owners, x.owner))
+        continue;
+      if(!x.owner && !core_items)
+        continue;
+      // the owner is the series of the renderer in the gpu memory counters
+      impl::trace::span span{"draw item", impl::trace::track::render, x.program, x.owner};
+      gl::memory::scope charge{x.owner};
+      if(!x.count) {
+        if(x.prepare)
+          x.prepare(x.user, {state});
+        // it may have changed any state behind the cache, e.g. a render()
+        // calling glUseProgram; the settings of the pass are restored
+        gl_state.invalidate();
+        gl_settings();
+        gl_state.depth_mask(pass == render_pass::opaque);
+        texture = gl::state::unknown;
+        continue;
+      }
+      gl_state.use_program(x.program);
+      gl_state.bind_vertex_array(x.vao);
+      if(x.texture != texture)
+        glBindTextureUnit(0, texture = x.texture);
+      if(x.prepare)
+        x.prepare(x.user, {state});
+      if(x.index_type) {
+        auto index_size = x.index_type == GL_UNSIGNED_BYTE ? 1
+          : x.index_type == GL_UNSIGNED_SHORT ? 2 : 4;
+        glDrawElementsInstanced(
+          x.mode,
+          x.count,
+          x.index_type,
+          (const void *) (size_t) (x.first * index_size),
+          x.instances
+        );
+      }
+      else
+        glDrawArraysInstanced(x.mode, x.first, x.count, x.instances);
+    }
   }
   
-  auto gl_settings() {
-    glEnable(GL_MULTISAMPLE);
-    glEnable(GL_DEPTH_TEST);
-    glDepthFunc(GL_LESS);
-    glEnable(GL_CULL_FACE);
-    glCullFace(GL_BACK);
-    glFrontFace(GL_CW);
-    glEnable(GL_BLEND);
-    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-    glPixelStorei(GL_PACK_ALIGNMENT, 1);
-    glClearColor(0.1, 0.1, 0.1, 1.0);
+  // over budget, surfaces kept for reuse go first, then multisampling down
+  // to 4x, then what renderers give back, largest first, then the rest of
+  // multisampling. it returns a step at a time while the frame fits into
+  // three quarters of the budget
+  void enforce_budget(impl::main_framebuffer &fb) {
+    auto &memory = gl::memory::get();
+    if(impl::trace::recorder::get().enabled()) {
+      memory.each([](unsigned owner, size_t bytes) { impl::trace::count("gpu memory", owner, bytes); });
+      impl::trace::count("gpu memory total", 0, memory.used());
+    }
+    auto budget = impl::gpu_budget.load(std::memory_order_relaxed);
+    if(!budget)
+      budget = std::numeric_limits<size_t>::max();
+    auto lower = [&] {
+      if(!fb.samples())
+        return false;
+      fb.set_samples(fb.samples() > 2 ? fb.samples() / 2 : 0);
+      fb.trim();
+      return true;
+    };
+    if(renderer_cooldown)
+      --renderer_cooldown;
+    if(memory.used() > budget) {
+      // the core gives up what it can first, renderers are asked after
+      fb.trim();
+      while(memory.used() > budget && lower());
+      if(memory.used() > budget && !renderer_cooldown) {
+        renderer_cooldown = renderer_interval;
+        std::vector<size_t> order(renderers.size());
+        std::iota(order.begin(), order.end(), 0);
+        std::ranges::sort(order, std::greater{}, [&](size_t i) { return memory.used(owners[i]); });
+        for(auto i:order) {
+          auto used = memory.used();
+          if(used <= budget)
+            break;
+          gl::memory::scope charge{owners[i]};
+          renderers[i]->release_memory(used - budget);
+        }
+      }
+    }
+    else {
+      // taken back in reverse order and only up to three quarters of the
+      // budget, so that it does not swing back and forth
+      auto room = budget / 4 * 3;
+      if(memory.used() < budget / 2 && !renderer_cooldown) {
+        renderer_cooldown = renderer_interval;
+        for(size_t i = 0; i < renderers.size() && memory.used() < room; ++i) {
+          gl::memory::scope charge{owners[i]};
+          renderers[i]->restore_memory(room - memory.used());
+        }
+      }
+      if(fb.samples() < fb.max_samples) {
+        auto next = std::max(fb.samples() * 2, 2);
+        if(memory.used() + fb.samples_cost(next) < room)
+          fb.set_samples(next);
+      }
+    }
+    impl::frame_samples = fb.samples();
+  }
+  
+  void gl_settings() {
+    auto &gl_state = gl::state::current();
+    gl_state.enable(GL_MULTISAMPLE);
+    gl_state.enable(GL_DEPTH_TEST);
+    gl_state.depth_func(GL_LESS);
+    gl_state.enable(GL_CULL_FACE);
+    gl_state.cull_face(GL_BACK);
+    gl_state.front_face(GL_CW);
+    gl_state.enable(GL_BLEND);
+    gl_state.blend_func(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+  }
+  
+  awaitable<void> trace_on_signal() {
+    asio::signal_set signals(ctx, SIGUSR1);
+    for(;;) {
+      co_await signals.async_wait(use_awaitable);
+      impl::trace::recorder::get().dump(trace_path.c_str());
+      std::cerr << "trace written to " << trace_path << "\n";
+    }
   }
   
   auto run() {
     setup_gl();
+    if(auto path = std::getenv("VISUALIZER_TRACE")) {
+      if(*path)
+        trace_path = path;
+      impl::trace::recorder::get().enable(true);
+      asio::co_spawn(ctx, trace_on_signal(), asio::detached);
+    }
+    loader = std::jthread{[this](std::stop_token stop) { load(stop); }};
+    asio::co_spawn(ctx, render(), asio::detached);
+    ctx.run();
+  }
+  
+  // must run on the io_context
+  void add_view(std::string ip, uint32_t port, plugin::projection p, bool worker = false) {
     asio::co_spawn(
       ctx,
-      [&] -> awaitable<void> {
-        asio::ip::tcp::endpoint ep(asio::ip::address::from_string(ip), port);
-        asio::ip::tcp::socket s(ctx);
-        std::cerr << "connecting\n";
-        co_await s.async_connect(ep, use_awaitable);
-        std::cerr << "connected\n";
+      [this, ip, port, &v = views.emplace_back(ctx, p, worker)] -> awaitable<void> {
         try {
+          asio::ip::tcp::endpoint ep(asio::ip::address::from_string(ip), port);
+          std::cerr << "connecting\n";
+          // workers may start before their compositor listens
+          for(asio::steady_timer retry(ctx);;) {
+            try {
+              co_await v.socket.async_connect(ep, use_awaitable);
+              break;
+            }
+            catch(boost::system::system_error &) {
+              if(!v.worker)
+                throw;
+            }
+            v.socket.close();
+            retry.expires_after(std::chrono::milliseconds(100));
+            co_await retry.async_wait(use_awaitable);
+          }
+          std::cerr << "connected\n";
+          v.connected = true;
+          frame_done.cancel();
           co_await asio::experimental::make_parallel_group(
-            asio::co_spawn(ctx, render(), asio::deferred),
-            asio::co_spawn(ctx, sender(s), asio::deferred),
-            asio::co_spawn(ctx, handle_updates(s), asio::deferred)
+            asio::co_spawn(ctx, sender(v), asio::deferred),
+            asio::co_spawn(ctx, handle_updates(v), asio::deferred)
           )
             .async_wait(
               asio::experimental::wait_for_one_error(),
@@ -206,58 +484,317 @@ struct render_core {
             );
         }
         catch(std::exception &x) { std::cerr << x.what() << "\n"; }
+        views.remove_if([&](view &x) { return &x == &v; });
+        frame_done.cancel();
       },
       asio::detached
     );
-    ctx.run();
   }
   
   struct vertex {
     glm::vec3 pos;
   };
   
+  // a buffer no sender holds anymore; there are at most the frames in
+  // flight of every view plus the one being written
+  std::shared_ptr<client_memory> acquire_frame() {
+    for(auto &f:frames)
+      if(f.use_count() == 1) {
+        f->color_image.unmap();
+        f->depth_image.unmap();
+        return f;
+      }
+    return frames.emplace_back(std::make_shared<client_memory>(
+      client_memory{.color_image = {{}}, .depth_image = {{}}}
+    ));
+  }
+  
+  // several senders may wait on the fence of a shared frame; the first one
+  // to see it signalled deletes it
+  awaitable<void> wait_for_gpu(GLsync &fence) {
+    asio::steady_timer poll(ctx);
+    for(auto flags = GL_SYNC_FLUSH_COMMANDS_BIT;
+      fence && glClientWaitSync(fence, flags, 0) == GL_TIMEOUT_EXPIRED;
+      flags = 0) {
+      poll.expires_after(std::chrono::microseconds(250));
+      co_await poll.async_wait(use_awaitable);
+    }
+    if(fence)
+      glDeleteSync(std::exchange(fence, nullptr));
+  }
+  
+  // a view without room drops its oldest frame the sender has not picked
+  // up yet for this one, or this one if the sender has them all
+  void publish_frame(view &v, view_frame f) {
+    if(v.in_flight >= v.depth) {
+      ++v.link.dropped;
+      if(!v.mailbox.try_receive([&](boost::system::error_code, view_frame) { --v.in_flight; }))
+        return;
+    }
+    if(v.mailbox.try_send(boost::system::error_code{}, std::move(f)))
+      ++v.in_flight;
+  }
+  
+  void frame_sent(view &v) {
+    --v.in_flight;
+    frame_done.cancel();
+  }
+  
+  // the next frame is rendered once a view that streams every frame has
+  // room for it, or after room_timeout so that a viewer which stopped
+  // reading cannot hold up the others, the loader and the budget
+  static constexpr auto room_timeout = std::chrono::milliseconds(100);
+  awaitable<void> wait_for_room() {
+    auto room = [&] {
+      bool any = false;
+      for(auto &v:views)
+        if(v.connected && (v.full_frames || v.worker || (v.roi.min.x < v.roi.max.x && v.roi.min.y < v.roi.max.y))) {
+          if(v.in_flight < v.depth)
+            return true;
+          any = true;
+        }
+      return !any;
+    };
+    auto deadline = asio::steady_timer::clock_type::now() + room_timeout;
+    while(!room() && asio::steady_timer::clock_type::now() < deadline) {
+      frame_done.expires_at(deadline);
+      try {
+        co_await frame_done.async_wait(use_awaitable);
+      }
+      catch(boost::system::system_error &) {}
+    }
+  }
+  
+  // what each view sends of this frame and the regions to read back for
+  // it; thumbnails are downscaled here
+  std::vector<impl::main_framebuffer::region> plan_streams(impl::main_framebuffer &fb) {
+    std::vector<impl::main_framebuffer::region> regions;
+    auto now = impl::link_monitor::clock::now();
+    auto limit = impl::main_framebuffer::max_size();
+    // thumbnails are packed in rows, the next one goes at shelf; thumbnails
+    // is the extent of all of them
+    glm::uvec2 shelf{}, thumbnails{};
+    for(auto &v:views) {
+      v.next = {nullptr, v.frame_state.frame_matrix, v.frame_id};
+      if(!v.connected || !v.placed)
+        continue;
+      auto size = v.rect.max - v.rect.min;
+      // compositors only understand full frames
+      if(v.full_frames || v.worker) {
+        v.next.full = {regions.size(), {{}, size}};
+        regions.push_back({v.rect, false, v.worker || v.reproject});
+      }
+      if(v.worker)
+        continue;
+      auto roi_min = glm::min(v.roi.min, size), roi_max = glm::min(v.roi.max, size);
+      if(roi_min.x < roi_max.x && roi_min.y < roi_max.y) {
+        v.next.roi = {regions.size(), {roi_min, roi_max}};
+        regions.push_back({{v.rect.min + roi_min, v.rect.min + roi_max}});
+      }
+      // never upscaled
+      auto thumbnail = glm::min(glm::min(v.thumbnail_size, size), limit);
+      if(thumbnail.x && thumbnail.y && now >= v.next_thumbnail) {
+        if(shelf.x + thumbnail.x > limit.x)
+          shelf = {0, thumbnails.y};
+        // one that does not fit anymore waits for a later frame
+        if(shelf.y + thumbnail.y <= limit.y) {
+          v.next_thumbnail = now + v.thumbnail_interval;
+          gl::ubox2 at{shelf, shelf + thumbnail};
+          v.next.thumbnail = {regions.size(), {{}, thumbnail}};
+          regions.push_back({at, true});
+          shelf.x = at.max.x;
+          thumbnails = glm::max(thumbnails, at.max);
+        }
+      }
+    }
+    if(thumbnails.x) {
+      fb.reserve_thumbnails(thumbnails);
+      for(auto &v:views)
+        if(v.next.thumbnail)
+          fb.downscale(v.rect, regions[v.next.thumbnail->part].rect);
+    }
+    return regions;
+  }
+  
+  // views in rows of one framebuffer, as large as the context and the
+  // frame headers allow; a view that does not fit skips the frame and is
+  // placed first in the next one
+  glm::uvec2 layout_views() {
+    auto limit = glm::min(impl::main_framebuffer::max_size(), glm::uvec2(impl::max_extent));
+    std::vector<view *> order;
+    for(auto &v:views)
+      if(v.connected && !v.placed)
+        order.push_back(&v);
+    for(auto &v:views)
+      if(v.connected && v.placed)
+        order.push_back(&v);
+    glm::uvec2 shelf{}, atlas{};
+    depth_wanted = false;
+    for(auto *v:order) {
+      v->camera.calculate_zoom();
+      v->camera.calculate_camera_pos();
+      v->frame_state = v->camera;
+      v->frame_state.res = glm::clamp(v->frame_state.res, glm::uvec2(1), limit);
+      v->frame_state.frame_matrix = v->frame_state.calculate_matrix();
+      auto res = v->frame_state.res;
+      if(shelf.x + res.x > limit.x)
+        shelf = {0, atlas.y};
+      v->placed = shelf.y + res.y <= limit.y;
+      if(!v->placed)
+        continue;
+      depth_wanted |= v->worker || v->reproject;
+      v->rect = {shelf, shelf + res};
+      shelf.x = v->rect.max.x;
+      atlas = glm::max(atlas, v->rect.max);
+    }
+    return atlas;
+  }
+  
+  void update(renderer_context::pimpl &state) {
+    update_failed.assign(renderers.size(), false);
+    // a few renderers are not worth waking the pool for, n <= chunk runs
+    // them on this thread
+    auto n = renderers.size();
+    auto chunk = n < pool.size() ? n : n / (pool.size() * 4);
+    pool.parallel_for(n, [&](size_t i) {
+      try {
+        renderers[i]->update({state});
+      }
+      catch(std::exception &e) {
+        std::cerr << "renderer update failed: " << e.what() << "\n";
+        update_failed[i] = true;
+      }
+      catch(...) {
+        std::cerr << "renderer update failed: unknown error\n";
+        update_failed[i] = true;
+      }
+    }, std::max<size_t>(1, chunk));
+    failed_owners.clear();
+    for(size_t i = 0; i < renderers.size(); ++i)
+      if(update_failed[i])
+        failed_owners.push_back(owners[i]);
+    std::ranges::sort(failed_owners);
+  }
+  
+  void draw_views(size_t frame) {
+    using impl::trace::span, impl::trace::track;
+    auto &gl_state = gl::state::current();
+    for(auto &v:views) {
+      if(!v.connected || !v.placed)
+        continue;
+      core_items = !v.worker || v.worker_index == 0;
+      {
+        span s{"update", track::render, frame};
+        update(v.frame_state);
+      }
+      gl_state.viewport({v.rect.min.x, v.rect.min.y, v.frame_state.res.x, v.frame_state.res.y});
+      {
+        span s{"draw opaque", track::render, frame};
+        draw(render_pass::opaque, v.frame_state);
+      }
+      if(culling) {
+        span s{"draw gpu objects", track::render, frame};
+        culling->cull(v.frame_state.frame_matrix, v.rect);
+        culling->draw({v.frame_state});
+      }
+      gl_state.depth_mask(false);
+      {
+        span s{"draw transparent", track::render, frame};
+        draw(render_pass::transparent, v.frame_state);
+      }
+      gl_state.depth_mask(true);
+    }
+  }
+  
   awaitable<void> render() try {
     using type = gl::shader_type;
-    auto render_state = render_data;
-    auto &res = render_state.res;
-    impl::main_framebuffer fb(res);
+    impl::main_framebuffer fb({1, 1});
+    asio::steady_timer pacing(ctx);
     
-    for(;;) {
-      for(std::function<renderer_base *()> elem;
-        constructor_queue.pop(&elem, 1);) {
-        try {
-          auto r = elem();
-          (r->is_transparent() ? transparent_renderers : opaque_renderers)
-            .emplace_back(r);
-        }
-        catch(...){
-        }
+    for(size_t frame = 0;; ++frame) {
+      using impl::trace::span, impl::trace::track;
+      auto frame_start = impl::link_monitor::clock::now();
+      {
+        span s{"join", track::render};
+        join_ready();
+        if(uploads.publish())
+          constructor_signal.release();
+        enforce_budget(fb);
+      }
+      auto atlas = layout_views();
+      if(!atlas.x) {
+        pacing.expires_after(impl::link_monitor::min_interval);
+        co_await pacing.async_wait(use_awaitable);
+        continue;
       }
-      render_data.calculate_zoom();
-      render_data.calculate_camera_pos();
-      render_state = render_data;
       
-      fb.resize(res);
-      auto data = co_await sender_to_render.async_receive(use_awaitable);
-      fb.initiate_transfer(data);
+      fb.resize(atlas);
       fb.bind();
       gl_settings();
+      gpu_timer.mark(0);
+      
+      sort_scene();
+      upload_objects();
+      draw_views(frame);
+      gpu_timer.mark(1);
       
-      for(auto &r:opaque_renderers) {
-        r->render({render_state});
-        co_await asio::this_coro::executor;
+      {
+        span s{"resolve", track::render, frame};
+        fb.resolve(depth_wanted || culling);
       }
-      glDepthMask(false);
-      for(auto &r:transparent_renderers) {
-        r->render({render_state});
-        co_await asio::this_coro::executor;
+      if(culling) {
+        span s{"depth pyramid", track::render, frame};
+        std::vector<impl::gpu_culling::hiz_view> drawn;
+        for(auto &v:views)
+          if(v.connected && v.placed)
+            drawn.push_back({v.rect, v.frame_state.frame_matrix});
+        culling->build_hiz(fb.read.depth, atlas, std::move(drawn));
       }
-      glDepthMask(true);
-      
-      fb.swap();
+      auto data = acquire_frame();
+      {
+        span s{"readback", track::render, frame};
+        fb.initiate_transfer(*data, plan_streams(fb));
+      }
+      auto render_time = impl::link_monitor::clock::now() - frame_start;
+      gpu_timer.mark(2);
+      gpu_timer.end_frame();
       window.swap();
       
-      co_await render_to_sender.async_send({}, std::move(data), use_awaitable);
+      // paced by the fastest viewer, slower ones drop frames
+      auto interval = impl::link_monitor::clock::duration::max();
+      auto now = impl::link_monitor::clock::now();
+      auto setting = impl::frames_in_flight.load(std::memory_order_relaxed);
+      for(auto &v:views) {
+        if(!v.connected)
+          continue;
+        using pixel = decltype(client_memory::color_image)::value_type;
+        auto area = [](const std::optional<view_frame::stream> &x) {
+          auto size = x ? x->rect.max - x->rect.min : glm::uvec2{};
+          return (size_t) size.x * size.y;
+        };
+        auto bytes = area(v.next.full)
+            * (sizeof(pixel) + (v.worker ? sizeof(float) : v.reproject ? sizeof(uint16_t) : 0))
+          + area(v.next.roi) * sizeof(pixel)
+          + area(v.next.thumbnail) * sizeof(pixel);
+        auto wanted = v.link.frame_interval(bytes);
+        // a view that only takes thumbnails needs no frame before its next
+        // one, a view that takes nothing is polled for subscriptions
+        if(!v.next.full && !v.next.roi)
+          wanted = std::max(wanted, v.thumbnail_size.x
+            ? v.next_thumbnail - now
+            : impl::link_monitor::clock::duration(std::chrono::milliseconds(100)));
+        v.pipeline.measured(impl::frame_pipeline::render, render_time);
+        v.depth = v.pipeline.depth(setting, wanted);
+        if(v.next.full || v.next.roi || v.next.thumbnail) {
+          v.next.memory = data;
+          publish_frame(v, std::move(v.next));
+        }
+        interval = std::min(interval, wanted);
+      }
+      span s{"pacing", track::render, frame};
+      pacing.expires_at(frame_start + interval);
+      co_await pacing.async_wait(use_awaitable);
+      co_await wait_for_room();
     }
   }
   catch(std::exception &e) {
@@ -265,162 +802,383 @@ struct render_core {
     throw;
   }
   
-  awaitable<void> handle_updates(asio::ip::tcp::socket &s) {
-    enum class type : uint32_t {
-      resize,
-      mouse_click,
-      mouse_down,
-      mouse_up,
-      mouse_wheel,
-      scroll,
-      mouse_drag,
-      mouse_move
-    };
-    struct {
-      glm::ivec3 data;
-      type t;
-    } msg;
+  awaitable<void> handle_updates(view &v) {
+    impl::input_message msg;
     for(;;) {
-      co_await async_read(s, asio::buffer(&msg, sizeof msg), use_awaitable);
-      msg.data.x = std::byteswap(msg.data.x);
-      msg.data.y = std::byteswap(msg.data.y);
-      msg.data.z = std::byteswap(msg.data.z);
-      msg.t = (type) std::byteswap(std::to_underlying(msg.t));
-      
+      {
+        impl::trace::span span{"wait input", impl::trace::track::input};
+        co_await async_read(v.socket, asio::buffer(&msg, sizeof msg), use_awaitable);
+      }
+      impl::decode(msg);
+      impl::trace::span span{"apply input", impl::trace::track::input, std::to_underlying(msg.t)};
+      if(v.camera.apply(msg))
+        continue;
       switch(msg.t) {
-      case type::resize: render_data.res = msg.data.xy();
+      case impl::input_type::reprojection: v.reproject = msg.data.x;
         break;
-      case type::mouse_down:
-        switch(msg.data.z) {
-        case 1: render_data.mouse_buttons.left = 1;
-          break;
-        case 2: render_data.mouse_buttons.middle = 1;
-          break;
-        case 3: render_data.mouse_buttons.right = 1;
-          break;
-        default: break;
-        }
-        render_data.mouse_pos = msg.data.xy();
+      case impl::input_type::region_of_interest: {
+        // the origin is sent back as 16 bit
+        glm::uvec2 min(glm::clamp(glm::ivec2(msg.data), 0, (int) impl::max_extent));
+        glm::uvec2 size((uint32_t) msg.data.z >> 16, (uint32_t) msg.data.z & 0xffff);
+        v.roi = {min, glm::min(min + size, glm::uvec2(impl::max_extent))};
+      }
         break;
-      case type::mouse_up:
-        switch(msg.data.z) {
-        case 1: render_data.mouse_buttons.left = 0;
-          break;
-        case 2: render_data.mouse_buttons.middle = 0;
-          break;
-        case 3: render_data.mouse_buttons.right = 0;
-          break;
-        default: break;
-        }
-        render_data.mouse_pos = msg.data.xy();
+      case impl::input_type::thumbnail:
+        v.thumbnail_size = glm::uvec2(glm::clamp(glm::ivec2(msg.data), 0, (int) impl::max_extent));
+        v.thumbnail_interval = msg.data.z > 0
+          ? impl::link_monitor::clock::duration(std::chrono::seconds(1)) / msg.data.z
+          : impl::link_monitor::clock::duration{};
+        v.next_thumbnail = {};
         break;
-      case type::mouse_drag: {
-        auto delta = msg.data.xy() - render_data.mouse_pos;
-        namespace num = std::numbers;
-        if(render_data.mouse_buttons.left)
-          render_data.dir = {
-            std::fmod(
-              (delta.x) / -400.f + render_data.dir.x,
-              (float) num::pi * 2.f
-            ),
-            std::clamp(
-              (delta.y) / 400.f + render_data.dir.y,
-              -(float) num::pi / 2.f,
-              (float) num::pi / 2.f
-            )
-          };
-        if(render_data.mouse_buttons.right) {
-          auto dir = render_data.dir.x;
-          auto dx = delta.x / -100.f * glm::vec2{cos(dir), -sin(dir)};
-          auto dy = delta.y / -100.f * glm::vec2{sin(dir), cos(dir)};
-          render_data.lookat
-            += render_data.zoom
-            * glm::vec3(dx + dy * (float) sin(render_data.dir.y), 0).xzy();
-        }
-        if(render_data.mouse_buttons.middle) {
-          render_data.zoom += delta.y / 400.f;
-        }
-        render_data.mouse_pos = msg.data.xy();
-      }
+      case impl::input_type::full_frames: v.full_frames = msg.data.x;
         break;
-      case type::mouse_move: render_data.mouse_pos = msg.data.xy();
+      case impl::input_type::worker_index: v.worker_index = msg.data.x;
         break;
-      case type::scroll: {
-        double amt
-          = std::bit_cast<double>(
-            std::array<int32_t, 2>{msg.data.y, msg.data.x}
-          );
-        render_data.logzoom += amt * 0.1;
-      }
+      case impl::input_type::frame_id: v.frame_id = msg.data.x;
         break;
       default: break;
       }
+      // subscriptions decide whether the render loop waits for this view
+      frame_done.cancel();
     }
   }
   
-  awaitable<void> sender(asio::ip::tcp::socket &s) {
+  awaitable<void> sender(view &v) {
+    using pixel = decltype(client_memory::color_image)::value_type;
+    std::vector<asio::const_buffer> buffers;
     for(size_t packetid = 0;; ++packetid) {
-      auto data = co_await render_to_sender.async_receive(use_awaitable);
-      const void *ptr = data.color_image.map(GL_READ_ONLY);
-      const auto *depth = data.depth_image.map(GL_READ_ONLY);
-      auto screenspace_xy
-        = glm::vec2(render_data.mouse_pos) * 2.f / glm::vec2(render_data.res)
-          - glm::vec2(1);
-      
-      auto clamped_pos = glm::clamp(
-        render_data.mouse_pos,
-        glm::ivec2{},
-        (glm::ivec2) data.size
-      );
-      
-      auto idx = clamped_pos.x + (clamped_pos.y) * data.size.x;
-      auto d = depth[idx];
-      glm::vec3 pt{screenspace_xy, d * 2 - 1};
-      auto mat = glm::inverse(render_data.calculate_matrix());
-      auto correct = [](auto &&p) { return p / p.w; };
-      [[maybe_unused]] auto pt2 = correct(mat * glm::vec4(pt, 1)).xyz();
+      using impl::trace::span, impl::trace::track;
+      std::optional<span> step{std::in_place, "wait frame", track::sender, packetid};
+      auto frame = co_await v.mailbox.async_receive(use_awaitable);
+      auto &data = frame.memory;
+      step.emplace("wait gpu", track::sender, packetid);
+      auto gpu_start = impl::link_monitor::clock::now();
+      co_await wait_for_gpu(data->ready);
+      step.emplace("send", track::sender, packetid);
+      auto send_start = impl::link_monitor::clock::now();
+      v.pipeline.measured(impl::frame_pipeline::gpu, send_start - gpu_start);
+      // a worker's first frames may predate its depth readback
+      if(v.worker && !(frame.full && data->parts[frame.full->part].has_depth)) {
+        frame_sent(v);
+        continue;
+      }
+      auto *color = data->color_image.map(GL_READ_ONLY);
+      auto *depth = data->has_depth ? data->depth_image.map(GL_READ_ONLY) : nullptr;
       
-      size_t size
-        = data.size.x * data.size.y * sizeof(decltype(data.color_image)::value_type);
-      struct {
-        uint16_t magic, w, h;
-        uint32_t total;
-      } header{
-        .magic = 0xADDE,
-        .w = std::byteswap((uint16_t) data.size.x),
-        .h = std::byteswap((uint16_t) data.size.y),
-        .total = std::byteswap((uint32_t) size)
+      // every header stays alive until the write is done
+      std::array<impl::frame_header, 4> headers;
+      size_t header_count = 0, total = 0;
+      buffers.clear();
+      auto add = [&](uint16_t magic, glm::uvec2 size, std::initializer_list<asio::const_buffer> payload) {
+        size_t bytes = 0;
+        for(auto &b:payload)
+          bytes += b.size();
+        auto &header = headers[header_count++] = impl::make_header(magic, size, bytes);
+        buffers.emplace_back((const void *) &header, sizeof header);
+        buffers.insert(buffers.end(), payload);
+        total += sizeof header + bytes;
       };
-      co_await asio::async_write(
-        s,
-        asio::const_buffer{(const void *) &header, sizeof header},
-        use_awaitable
-      );
-      co_await asio::async_write(
-        s,
-        asio::const_buffer{(const void *) ptr, size},
-        use_awaitable
-      );
-      data.depth_image.unmap();
-      data.color_image.unmap();
-      co_await sender_to_render.async_send({}, std::move(data), use_awaitable);
+      auto pixels = [&](const view_frame::stream &x) {
+        auto size = x.rect.max - x.rect.min;
+        return asio::const_buffer(color + data->parts[x.part].offset, (size_t) size.x * size.y * sizeof(pixel));
+      };
+      
+      // matrix and 16 bit depth of this frame follow its color, both big
+      // endian
+      std::array<uint32_t, 16> matrix_bits;
+      uint32_t frame_id = std::byteswap(frame.id);
+      if(frame.full) {
+        auto size = frame.full->rect.max - frame.full->rect.min;
+        auto part = data->parts[frame.full->part];
+        auto *full_depth = part.has_depth ? depth + part.offset : nullptr;
+        // the world position under the mouse, for input that acts on it
+        if(full_depth)
+          v.camera.cursor_pos = impl::cursor_position(
+            full_depth, size.x, {}, size, v.camera.mouse_pos, frame.matrix
+          );
+        if(v.worker)
+          add(impl::depth_frame, size, {
+            asio::buffer(&frame_id, sizeof frame_id),
+            pixels(*frame.full),
+            asio::const_buffer(full_depth, (size_t) size.x * size.y * sizeof(float))
+          });
+        else
+          add(impl::color_frame, size, {pixels(*frame.full)});
+        if(v.reproject && full_depth) {
+          for(int i = 0; i < 16; ++i)
+            matrix_bits[i] = std::byteswap(std::bit_cast<uint32_t>(frame.matrix[i / 4][i % 4]));
+          v.depth_plane.resize((size_t) size.x * size.y);
+          pool.parallel_for(size.y, [&](size_t y) {
+            impl::quantize_depth(full_depth + y * size.x, v.depth_plane.data() + y * size.x, size.x);
+          }, 16);
+          add(impl::reprojection_frame, size, {
+            asio::buffer(matrix_bits),
+            asio::buffer(v.depth_plane)
+          });
+        }
+      }
+      std::array<uint16_t, 2> roi_origin;
+      if(frame.roi) {
+        roi_origin = {
+          std::byteswap((uint16_t) frame.roi->rect.min.x),
+          std::byteswap((uint16_t) frame.roi->rect.min.y)
+        };
+        add(impl::roi_frame, frame.roi->rect.max - frame.roi->rect.min, {
+          asio::buffer(roi_origin),
+          pixels(*frame.roi)
+        });
+      }
+      if(frame.thumbnail)
+        add(impl::thumbnail_frame, frame.thumbnail->rect.max, {pixels(*frame.thumbnail)});
+      co_await asio::async_write(v.socket, buffers, use_awaitable);
+      auto took = impl::link_monitor::clock::now() - send_start;
+      v.pipeline.measured(impl::frame_pipeline::send, took);
+      v.link.sent(total, took);
+      frame_sent(v);
+      v.link.sample(v.socket.native_handle());
     }
   }
 };
 
-boost::lockfree::spsc_queue<std::function<renderer_base *()>>
-  render_core::constructor_queue{1024};
+impl::constructor_queue render_core::constructor_queue;
+std::counting_semaphore<> render_core::constructor_signal{0};
 namespace impl {
 void add(const std::function<renderer_base *()>& f) {
-  render_core::constructor_queue.push(f);
+  if(render_core::constructor_queue.push(f))
+    render_core::constructor_signal.release();
+}
+
+void provide(std::string_view type, factory f, restorer r) {
+  plugin_registry::get().provide(type, f, r);
+}
+
+// the recorded value of the renderer the loader constructs and the blobs it
+// is restored with
+thread_local size_t constructing_value = -1;
+thread_local std::span<const std::span<const std::byte>> restored_blobs;
+
+renderer_base *construct(std::string_view type, const void *value, size_t snapshot_value) {
+  auto f = plugin_registry::get().find(type).make;
+  if(!f)
+    throw std::runtime_error("no renderer for " + std::string(type));
+  constructing = type;
+  constructing_value = snapshot_value;
+  restored_blobs = {};
+  auto r = f(value);
+  constructing_value = -1;
+  return r;
+}
+
+renderer_base *restore(
+  std::string_view type,
+  std::span<const std::byte> value,
+  size_t snapshot_value,
+  std::span<const std::span<const std::byte>> blobs
+) {
+  auto f = plugin_registry::get().find(type).restore;
+  if(!f)
+    throw std::runtime_error("cannot restore a renderer for " + std::string(type));
+  constructing = type;
+  constructing_value = snapshot_value;
+  restored_blobs = blobs;
+  auto r = f(value);
+  constructing_value = -1;
+  restored_blobs = {};
+  return r;
+}
+
+std::atomic<bool> recording = [] {
+  auto env = std::getenv("VISUALIZER_SNAPSHOTS");
+  return env && *env && *env != '0';
+}();
+std::mutex recorded_mutex;
+std::vector<snapshot::value> recorded;
+
+bool snapshots_enabled() { return recording.load(std::memory_order_relaxed); }
+
+size_t record(std::string_view type, std::vector<std::byte> value) {
+  std::lock_guard lock(recorded_mutex);
+  recorded.push_back({std::string(type), std::move(value)});
+  return recorded.size() - 1;
 }
 } // namespace impl
 
+void keep_for_snapshot(std::span<const std::byte> data) {
+  if(impl::constructing_value == size_t(-1))
+    return;
+  std::lock_guard lock(impl::recorded_mutex);
+  impl::recorded[impl::constructing_value].blobs.emplace_back(data.begin(), data.end());
+}
+
+std::span<const std::byte> restored_blob(size_t i) {
+  return i < impl::restored_blobs.size() ? impl::restored_blobs[i] : std::span<const std::byte>{};
+}
+
+void parallel_for(size_t n, const std::function<void(size_t)> &f, size_t chunk) {
+  // apart from the per-frame pool of the render loop, which it would stall
+  static impl::thread_pool pool;
+  static std::mutex m;
+  std::lock_guard lock(m);
+  pool.parallel_for(n, f, chunk);
+}
+
+void enable_snapshots(bool on) { impl::recording = on; }
+
+void save_snapshot(const char *path) {
+  std::vector<impl::snapshot::value> values;
+  {
+    std::lock_guard lock(impl::recorded_mutex);
+    values = impl::recorded;
+  }
+  std::vector<std::vector<char>> binaries;
+  std::vector<impl::snapshot::program> programs;
+  gl::program_cache::get().each([&](uint64_t key, unsigned format, std::span<const char> data) {
+    programs.push_back({key, format, binaries.emplace_back(data.begin(), data.end())});
+  });
+  impl::snapshot::write(path, values, programs);
+}
+
+// the mapping stays alive until the loader has constructed every restored
+// renderer, values are decoded and blobs uploaded straight out of it
+void restore_snapshot(const char *path) {
+  using impl::snapshot::kind;
+  struct restored {
+    std::string type;
+    std::span<const std::byte> data;
+    std::vector<std::span<const std::byte>> blobs;
+  };
+  auto file = std::make_shared<const impl::snapshot::mapping>(path);
+  std::vector<restored> values;
+  file->each([&](kind k, const impl::snapshot::record &r, std::string_view name, std::span<const std::byte> data) {
+    if(k == kind::program)
+      gl::program_cache::get().insert(r.key, r.format, {(const char *) data.data(), data.size()});
+    else if(k == kind::value)
+      values.push_back({std::string(name), data, {}});
+    else if(r.key < values.size())
+      values[r.key].blobs.push_back(data);
+  });
+  for(auto &v:values) {
+    size_t index = -1;
+    if(impl::snapshots_enabled())
+      index = impl::record(v.type, {v.data.begin(), v.data.end()});
+    impl::add([file, v = std::move(v), index] { return impl::restore(v.type, v.data, index, v.blobs); });
+  }
+}
+
+void add_plugin_directory(const char *path) {
+  impl::plugin_registry::get().scan(path);
+}
+
+void enable_tracing(bool on) { impl::trace::recorder::get().enable(on); }
+
+void dump_trace(const char *path) { impl::trace::recorder::get().dump(path); }
+
+gpu_memory_usage gpu_memory() {
+  gpu_memory_usage r{
+    gl::memory::get().used(),
+    impl::gpu_budget.load(std::memory_order_relaxed),
+    impl::frame_samples.load(std::memory_order_relaxed)
+  };
+  std::lock_guard lock(impl::owners_mutex);
+  gl::memory::get().each([&](unsigned owner, size_t bytes) {
+    if(!bytes)
+      return;
+    auto it = impl::owner_names.find(owner);
+    r.owners.push_back({it == impl::owner_names.end() ? "#" + std::to_string(owner) : it->second, bytes});
+  });
+  return r;
+}
+
+void set_gpu_budget(size_t bytes) { impl::gpu_budget = bytes; }
+
+void set_frames_in_flight(unsigned n) { impl::frames_in_flight = n; }
+
 std::optional<std::thread> thread{};
 
-void open(const char *ip, uint32_t port) {
-  static render_core app{ip, port};
-  thread = std::thread{[&] { app.run(); }};
+void open(const char *ip, uint32_t port) { open(ip, port, projection::perspective); }
+
+render_core &app() {
+  static render_core app;
+  static std::once_flag started;
+  std::call_once(started, [&] { thread = std::thread{[&] { app.run(); }}; });
+  return app;
+}
+
+streamed_texture::streamed_texture(glm::uvec2 size, unsigned internal_format, int levels) :
+  s(std::make_shared<state>()) {
+  s->size = size;
+  s->format = internal_format;
+  s->levels = levels;
+  s->owner = gl::memory::current();
+  app().uploads.add(s);
+}
+
+void streamed_texture::write(
+  glm::uvec2 offset,
+  glm::uvec2 size,
+  unsigned format,
+  unsigned type,
+  size_t bytes,
+  std::function<void(std::span<std::byte>)> fill
+) {
+  auto end = offset + size;
+  if(end.x > s->size.x || end.y > s->size.y || end.x < offset.x || end.y < offset.y)
+    throw std::out_of_range("texture write outside the image");
+  // rows are tightly packed, the loader unpacks with an alignment of 1
+  auto pixel = gl::client_pixel_bytes(format, type);
+  if(!pixel)
+    throw std::invalid_argument("texture write with an unknown format or type");
+  if(bytes < size_t(size.x) * size.y * pixel)
+    throw std::invalid_argument("texture write smaller than its region");
+  {
+    std::lock_guard lock(s->m);
+    // queued writes this one covers are never uploaded
+    std::erase_if(s->queued, [&](const state::request &r) {
+      return r.region.min.x >= offset.x && r.region.min.y >= offset.y
+        && r.region.max.x <= end.x && r.region.max.y <= end.y;
+    });
+    s->queued.push_back({{offset, end}, format, type, bytes, std::move(fill)});
+  }
+  render_core::constructor_signal.release();
+}
+
+void streamed_texture::write(
+  glm::uvec2 offset,
+  glm::uvec2 size,
+  unsigned format,
+  unsigned type,
+  std::span<const std::byte> pixels
+) {
+  write(offset, size, format, type, pixels.size(),
+    [copy = std::vector<std::byte>(pixels.begin(), pixels.end())](std::span<std::byte> out) {
+      std::ranges::copy(copy, out.begin());
+    });
+}
+
+unsigned streamed_texture::native() const {
+  return s && s->front >= 0 ? s->textures[s->front].native() : 0;
+}
+
+glm::uvec2 streamed_texture::size() const { return s->size; }
+
+void open(const char *ip, uint32_t port, projection p) {
+  auto &core = app();
+  asio::post(core.ctx, [&core, ip = std::string(ip), port, p] { core.add_view(ip, port, p); });
+}
+
+void open_worker(const char *ip, uint32_t port) {
+  auto &core = app();
+  asio::post(core.ctx, [&core, ip = std::string(ip), port] {
+    core.add_view(ip, port, projection::perspective, true);
+  });
+}
+
+void composite(const char *ip, uint32_t port, uint32_t worker_port, unsigned workers) {
+  static impl::compositor c;
+  static std::once_flag started;
+  std::call_once(started, [&] {
+    std::thread{[=, ip = std::string(ip)] { c.run(ip, port, worker_port, workers); }}.detach();
+  });
 }
 
 } // namespace plugin
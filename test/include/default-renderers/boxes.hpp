@@ -0,0 +1,9 @@
+#pragma once
+#include <glm/glm.hpp>
+
+namespace default_renderers {
+// std::vector<box> is drawn as gpu objects, one per box, culled by the core
+struct box{
+  glm::vec3 lo, hi;
+};
+}
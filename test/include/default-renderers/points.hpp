@@ -0,0 +1,11 @@
+#pragma once
+#include <glm/glm.hpp>
+
+namespace default_renderers {
+// std::vector<glm::vec3> and std::vector<colored_point> are drawn as point
+// clouds; uncolored points are tinted by their position in the cloud
+struct colored_point{
+  glm::vec3 pos;
+  glm::u8vec4 color;
+};
+}
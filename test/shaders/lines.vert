@@ -0,0 +1,12 @@
+#version 430
+// sample gl_VertexID; without xs its x is the index relative to base, the
+// first sample drawn
+layout(std430, binding = 0) readonly buffer ys_buffer{ float ys[]; };
+layout(std430, binding = 2) readonly buffer xs_buffer{ float xs[]; };
+uniform mat4 mvp;
+uniform bool has_x;
+uniform int base;
+void main(){
+  float x = has_x ? xs[gl_VertexID] : float(gl_VertexID - base);
+  gl_Position = mvp * vec4(x, ys[gl_VertexID], 0.0, 1.0);
+}
@@ -0,0 +1,19 @@
+#version 430
+// two vertices per bucket of a pyramid level, at its minimum and maximum;
+// x as in lines.vert
+layout(std430, binding = 1) readonly buffer pyramid_buffer{ vec2 pyramid[]; };
+layout(std430, binding = 2) readonly buffer xs_buffer{ float xs[]; };
+uniform mat4 mvp;
+uniform bool has_x;
+uniform int base;
+uniform int level_offset;
+uniform int bucket_size;
+uniform int sample_count;
+void main(){
+  int bucket = gl_VertexID / 2;
+  vec2 range = pyramid[level_offset + bucket];
+  int i = min(bucket * bucket_size + bucket_size / 2, sample_count - 1);
+  float x = has_x ? xs[i] : float(i - base);
+  float y = (gl_VertexID & 1) == 0 ? range.x : range.y;
+  gl_Position = mvp * vec4(x, y, 0.0, 1.0);
+}
@@ -0,0 +1,7 @@
+#version 330
+in vec3 point_color;
+out vec4 frag_color;
+void main()
+{
+  frag_color = vec4(point_color, 1.0);
+}
@@ -0,0 +1,12 @@
+#version 330
+in vec3 pos;
+in vec4 color;
+uniform mat4 mvp;
+uniform bool has_color;
+uniform vec3 lo;
+uniform vec3 extent;
+out vec3 point_color;
+void main(){
+  gl_Position = mvp * vec4(pos, 1.0);
+  point_color = has_color ? color.rgb / 255.0 : (pos - lo) / extent;
+}
@@ -0,0 +1,204 @@
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "visualizer-plugin/visualizer-plugin.hpp"
+#include "camera.hpp"
+#include "constructor_queue.hpp"
+#include "depth_quantize.hpp"
+#include "protocol.hpp"
+
+// microbenchmarks of the per message and per frame cpu paths.
+// usage: bench [--json] [filter]
+// --json prints one object per line instead of the table, for diffing runs
+
+namespace {
+template<class T>
+void keep(const T& x){
+  asm volatile("" : : "r"(&x) : "memory");
+}
+
+struct result{
+  std::string name;
+  double ns_per_op;
+  double bytes_per_second;
+  size_t iterations;
+};
+
+using clock_type = std::chrono::steady_clock;
+
+// batch(n) runs n operations. batches double until one takes 50 ms, the
+// median of 5 such batches counts
+template<class F>
+result measure(std::string name, size_t bytes_per_op, F&& batch){
+  size_t n = 1;
+  for(;;){
+    auto start = clock_type::now();
+    batch(n);
+    if(clock_type::now() - start > std::chrono::milliseconds(50))
+      break;
+    n *= 2;
+  }
+  std::vector<double> samples;
+  for(int r = 0; r < 5; ++r){
+    auto start = clock_type::now();
+    batch(n);
+    std::chrono::duration<double, std::nano> t = clock_type::now() - start;
+    samples.push_back(t.count() / n);
+  }
+  std::ranges::nth_element(samples, samples.begin() + 2);
+  auto ns = samples[2];
+  return {std::move(name), ns, bytes_per_op ? bytes_per_op / ns * 1e9 : 0, n};
+}
+
+// big endian, as a viewer sends them
+plugin::impl::input_message encoded(plugin::impl::input_type t, glm::ivec3 data){
+  plugin::impl::input_message m{data, t};
+  plugin::impl::decode(m);
+  return m;
+}
+
+plugin::impl::camera make_camera(){
+  plugin::impl::camera c{{1920, 1080}, {1, 0.5}};
+  c.calculate_zoom();
+  c.calculate_camera_pos();
+  c.frame_matrix = c.calculate_matrix();
+  return c;
+}
+}
+
+int main(int argc, char** argv){
+  using namespace plugin::impl;
+  bool json = false;
+  std::string filter;
+  for(int i = 1; i < argc; ++i)
+    if(!std::strcmp(argv[i], "--json"))
+      json = true;
+    else
+      filter = argv[i];
+  std::vector<result> results;
+  auto run_batch = [&](std::string name, size_t bytes, auto&& batch){
+    if(name.find(filter) != std::string::npos)
+      results.push_back(measure(std::move(name), bytes, batch));
+  };
+  auto run = [&](std::string name, size_t bytes, auto&& op){
+    run_batch(std::move(name), bytes, [&](size_t n){
+      for(size_t i = 0; i < n; ++i)
+        op(i);
+    });
+  };
+
+  {
+    std::array<input_message, 4> messages{
+      encoded(input_type::mouse_down, {100, 100, 1}),
+      encoded(input_type::mouse_drag, {140, 120, 0}),
+      encoded(input_type::mouse_drag, {90, 110, 0}),
+      encoded(input_type::mouse_up, {90, 110, 1})
+    };
+    auto camera = make_camera();
+    run("input/decode", sizeof(input_message), [&](size_t i){
+      auto m = messages[i % messages.size()];
+      decode(m);
+      keep(m);
+    });
+    run("input/decode+apply", sizeof(input_message), [&](size_t i){
+      auto m = messages[i % messages.size()];
+      decode(m);
+      camera.apply(m);
+      keep(camera);
+    });
+  }
+
+  {
+    auto camera = make_camera();
+    run("camera/calculate_camera_pos", 0, [&](size_t i){
+      camera.dir.x = i * 1e-3f;
+      camera.calculate_camera_pos();
+      keep(camera.camera_pos);
+    });
+    run("camera/calculate_matrix", 0, [&](size_t i){
+      camera.lookat.x = i * 1e-3f;
+      auto m = camera.calculate_matrix();
+      keep(m);
+    });
+  }
+
+  glm::uvec2 atlas{3840, 1080}, view{1920, 1080};
+  std::vector<float> depth(atlas.x * atlas.y);
+  for(size_t i = 0; i < depth.size(); ++i)
+    depth[i] = (i % 1021) / 1021.f;
+  {
+    auto camera = make_camera();
+    run("sender/cursor_position", 0, [&](size_t i){
+      glm::ivec2 mouse(i % view.x, i / view.x % view.y);
+      auto p = cursor_position(depth.data(), atlas.x, {view.x, 0}, view, mouse, camera.frame_matrix);
+      keep(p);
+    });
+  }
+
+  {
+    struct pixel{
+      char b, g, r;
+    };
+    std::vector<pixel> color(atlas.x * atlas.y);
+    std::vector<std::byte> out(view.x * view.y * sizeof(pixel) + sizeof(frame_header));
+    auto frame_bytes = view.x * view.y * sizeof(pixel);
+    run("sender/header", sizeof(frame_header), [&](size_t i){
+      auto h = make_header(color_frame, view, frame_bytes + i);
+      keep(h);
+    });
+    // the rows of the second view of the atlas, gathered as the socket
+    // write does it
+    run("sender/encode_color", frame_bytes, [&](size_t){
+      auto h = make_header(color_frame, view, frame_bytes);
+      std::memcpy(out.data(), &h, sizeof h);
+      auto at = out.data() + sizeof h;
+      for(size_t y = 0; y < view.y; ++y, at += view.x * sizeof(pixel))
+        std::memcpy(at, color.data() + y * atlas.x + view.x, view.x * sizeof(pixel));
+      keep(out);
+    });
+    std::vector<uint16_t> plane(view.x * view.y);
+    run("sender/quantize_depth", view.x * view.y * sizeof(float), [&](size_t){
+      for(size_t y = 0; y < view.y; ++y)
+        quantize_depth(depth.data() + y * atlas.x + view.x, plane.data() + y * view.x, view.x);
+      keep(plane);
+    });
+  }
+
+  {
+    // the queue the loader takes renderer constructors from, with a
+    // producer and the loader on separate threads
+    plugin::impl::constructor_queue queue;
+    run_batch("loader/constructor_queue", 0, [&](size_t n){
+      std::jthread producer([&]{
+        for(size_t i = 0; i < n; ++i)
+          while(!queue.push([i]{ return (plugin::renderer_base*)nullptr; }))
+            std::this_thread::yield();
+      });
+      plugin::impl::constructor_queue::constructor f;
+      for(size_t got = 0; got < n;)
+        if(queue.pop(f))
+          ++got;
+        else
+          std::this_thread::yield();
+      keep(f);
+    });
+  }
+
+  for(auto& r:results)
+    if(json)
+      std::printf(
+        "{\"name\":\"%s\",\"ns_per_op\":%.3f,\"bytes_per_second\":%.0f,\"iterations\":%zu}\n",
+        r.name.c_str(), r.ns_per_op, r.bytes_per_second, r.iterations
+      );
+    else if(r.bytes_per_second)
+      std::printf("%-32s %12.1f ns/op %10.1f MB/s\n", r.name.c_str(), r.ns_per_op, r.bytes_per_second / 1e6);
+    else
+      std::printf("%-32s %12.1f ns/op\n", r.name.c_str(), r.ns_per_op);
+}
@@ -0,0 +1,83 @@
+#include "visualizer-plugin/visualizer-plugin.hpp"
+#include "visualizer-plugin/abstraction/gl.hpp"
+#include "default-renderers/boxes.hpp"
+#include "resources.hpp"
+#include <array>
+#include <cstdint>
+#include <vector>
+
+namespace plugin::impl {
+inline  namespace default_renderers {
+
+// every box has its own 8 corners and shares the 36 indices, an object
+// reaches its corners by base_vertex
+struct boxes: renderer_base{
+  struct vertex{
+    glm::vec3 pos;
+  };
+  // corner i is at hi on x, y, z for bits 1, 2, 4; faces clockwise seen
+  // from outside
+  static constexpr std::array<std::array<uint32_t, 4>, 6> faces{{
+    {6, 7, 5, 4}, {3, 2, 0, 1},
+    {7, 3, 1, 5}, {2, 6, 4, 0},
+    {2, 3, 7, 6}, {4, 5, 1, 0}
+  }};
+  gl::program p = {
+    gl::shader<gl::shader_type::vertex>  {get_file("shaders/cube.vert")},
+    gl::shader<gl::shader_type::fragment>{get_file("shaders/cube.frag")}
+  };
+  std::vector<gpu_object> objects;
+  gl::buffer<vertex> corners;
+  gl::buffer<uint32_t> indices;
+  gl::vertex_array vao;
+  int mvp_loc = p.uniform_loc("mvp");
+
+  boxes(const std::vector<::default_renderers::box>& source){
+    if(source.empty())
+      return;
+    std::vector<vertex> data;
+    data.reserve(source.size() * 8);
+    for(auto& b:source){
+      for(int i = 0; i < 8; ++i)
+        data.push_back({{i & 1 ? b.hi.x : b.lo.x, i & 2 ? b.hi.y : b.lo.y, i & 4 ? b.hi.z : b.lo.z}});
+      objects.push_back({
+        .mode = GL_TRIANGLES,
+        .center = (b.lo + b.hi) / 2.f,
+        .radius = glm::length(b.hi - b.lo) / 2,
+        .count = 36,
+        .base_vertex = (int)(data.size() - 8),
+        .user = this
+      });
+    }
+    std::vector<uint32_t> order;
+    for(auto& f:faces)
+      order.insert(order.end(), {f[0], f[1], f[2], f[0], f[2], f[3]});
+    corners = gl::buffer<vertex>(std::span<const vertex>(data), 0);
+    indices = gl::buffer<uint32_t>(std::span<const uint32_t>(order), 0);
+    vao = {p, corners, indices};
+  }
+  bool is_transparent() const override {
+    return false;
+  }
+  // the vertex array is created here, on the render context
+  void submit(render_queue& q) override{
+    for(auto& o:objects){
+      o.program = p.native();
+      o.vao = vao.native();
+      o.prepare = [](void* self, const renderer_context ctx){
+        auto& b = *static_cast<boxes*>(self);
+        glUniformMatrix4fv(b.mvp_loc, 1, false, &ctx.matrix()[0][0]);
+      };
+      q.push_object(o);
+    }
+  }
+};
+
+}
+}
+
+template<>
+struct plugin::renderer<std::vector<default_renderers::box>>::type: plugin::impl::boxes{
+  type(const std::vector<default_renderers::box>& x):boxes(x){}
+};
+VISUALIZER_PLUGIN_RENDERER(std::vector<default_renderers::box>);
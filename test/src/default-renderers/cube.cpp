@@ -1,21 +1,8 @@
 #include "visualizer-plugin/visualizer-plugin.hpp"
 #include "visualizer-plugin/abstraction/gl.hpp"
-#include <cmrc/cmrc.hpp>
+#include "resources.hpp"
 #include <iostream>
 
-CMRC_DECLARE(default_renderers);
-
-namespace plugin::impl {
-inline  namespace default_renderers {
-
-inline std::string_view get_file(const char *path) {
-  auto fs = cmrc::default_renderers::get_filesystem();
-  auto file = fs.open(path);
-  return {file.begin(), file.end()};
-}
-
-}
-}
 template<>
 struct plugin::renderer<int>::type: plugin::renderer_base{
   
@@ -36,17 +23,25 @@ struct plugin::renderer<int>::type: plugin::renderer_base{
     {{-1.f,  1.f, -1.f}}, {{ 1.f,  1.f, -1.f}}
   };
   gl::vertex_array cube_vao = {cube_p, cube_mesh};
+  int size_loc = cube_p.uniform_loc("size");
+  int mvp_loc = cube_p.uniform_loc("mvp");
   type(int){}
   bool is_transparent() const override {
     return false;
   }
-  void render(plugin::renderer_context ctx) override{
-      cube_p.bind();
-      glUniform2f(cube_p.uniform_loc("size"), ctx.resolution().x, ctx.resolution().y);
-      glUniformMatrix4fv(cube_p.uniform_loc("mvp"), 1, false, &ctx.matrix()[0][0]);
-      cube_vao.bind();
-      glDrawArrays(GL_TRIANGLE_STRIP, 0, cube_mesh.size());
-
+  void submit(plugin::render_queue& q) override{
+    q.push({
+      .program = cube_p.native(),
+      .vao = cube_vao.native(),
+      .mode = GL_TRIANGLE_STRIP,
+      .count = (int)cube_mesh.size(),
+      .prepare = [](void* self, const plugin::renderer_context ctx){
+        auto& cube = *static_cast<type*>(self);
+        glUniform2f(cube.size_loc, ctx.resolution().x, ctx.resolution().y);
+        glUniformMatrix4fv(cube.mvp_loc, 1, false, &ctx.matrix()[0][0]);
+      },
+      .user = this
+    });
   }
 };
-template void plugin::renderer<int>::add(int);
+VISUALIZER_PLUGIN_RENDERER(int);
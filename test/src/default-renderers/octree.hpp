@@ -0,0 +1,248 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <queue>
+#include <span>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "visualizer-plugin/visualizer-plugin.hpp"
+
+namespace plugin::impl {
+inline  namespace default_renderers {
+
+// level-of-detail octree in the style of potree: every node keeps an evenly
+// spread sample of the points below it and its children only hold the rest,
+// so drawing a node and any subset of its descendants never draws a point
+// twice. points are reordered so every node is one contiguous range
+template<class P>
+struct octree{
+  struct node{
+    glm::vec3 center;
+    float half;
+    uint32_t first, count;
+    std::array<int32_t, 8> children;
+  };
+  // points a node keeps before it splits
+  static constexpr size_t capacity = 8192;
+  static constexpr int max_depth = 21;
+
+  octree() = default;
+  template<class S, class Position>
+  octree(std::span<const S> source, Position&& position){
+    if(source.empty())
+      return;
+    glm::vec3 lo = position(source[0]), hi = lo;
+    size_t chunk = 1 << 16, chunks = (source.size() + chunk - 1) / chunk;
+    std::vector<std::pair<glm::vec3, glm::vec3>> bounds(chunks, {lo, hi});
+    plugin::parallel_for(chunks, [&](size_t c){
+      auto& [l, h] = bounds[c];
+      for(size_t i = c * chunk; i < std::min(source.size(), (c + 1) * chunk); ++i){
+        l = glm::min(l, position(source[i]));
+        h = glm::max(h, position(source[i]));
+      }
+    });
+    for(auto& [l, h]:bounds){
+      lo = glm::min(lo, l);
+      hi = glm::max(hi, h);
+    }
+    this->lo = lo;
+    extent = glm::max(hi - lo, glm::vec3(1e-6f));
+    auto half = std::max({extent.x, extent.y, extent.z}) / 2 * 1.0001f;
+    auto center = lo + half;
+
+    // morton order, bucketed by the first two levels so the buckets sort
+    // in parallel
+    std::vector<entry> entries(source.size());
+    plugin::parallel_for(chunks, [&](size_t c){
+      for(size_t i = c * chunk; i < std::min(source.size(), (c + 1) * chunk); ++i)
+        entries[i] = {morton((position(source[i]) - (center - half)) / (2 * half)), (uint32_t)i};
+    });
+    std::array<size_t, 65> offsets{};
+    for(auto& e:entries)
+      ++offsets[(e.code >> (3 * (max_depth - 2))) + 1];
+    for(size_t i = 1; i < offsets.size(); ++i)
+      offsets[i] += offsets[i - 1];
+    {
+      auto fill = offsets;
+      std::vector<entry> bucketed(entries.size());
+      for(auto& e:entries)
+        bucketed[fill[e.code >> (3 * (max_depth - 2))]++] = e;
+      entries.swap(bucketed);
+    }
+    plugin::parallel_for(64, [&](size_t b){
+      std::sort(entries.begin() + offsets[b], entries.begin() + offsets[b + 1]);
+    });
+
+    // the first two levels are built here, the subtrees below in parallel
+    std::vector<task> tasks;
+    build(entries, 0, entries.size(), 0, center, half, nodes, &tasks);
+    std::vector<std::vector<node>> subtrees(tasks.size());
+    plugin::parallel_for(tasks.size(), [&](size_t i){
+      auto& t = tasks[i];
+      build(entries, t.begin, t.end, t.depth, t.center, t.half, subtrees[i], nullptr);
+    });
+    for(size_t i = 0; i < tasks.size(); ++i){
+      auto offset = (int32_t)nodes.size();
+      for(auto& n:subtrees[i])
+        for(auto& c:n.children)
+          if(c >= 0)
+            c += offset;
+      nodes.insert(nodes.end(), subtrees[i].begin(), subtrees[i].end());
+      if(tasks[i].parent >= 0)
+        nodes[tasks[i].parent].children[tasks[i].slot] = offset;
+    }
+
+    points.resize(entries.size());
+    plugin::parallel_for(chunks, [&](size_t c){
+      for(size_t i = c * chunk; i < std::min(source.size(), (c + 1) * chunk); ++i)
+        points[i] = P{source[entries[i].index]};
+    });
+  }
+
+  // ranges to draw for a camera, coarse to fine by projected size until
+  // the budget is spent
+  void select(
+    const glm::mat4& matrix,
+    glm::vec3 eye,
+    float pixels_per_radian,
+    size_t budget,
+    std::vector<int>& firsts,
+    std::vector<int>& counts
+  ) const{
+    firsts.clear();
+    counts.clear();
+    if(nodes.empty())
+      return;
+    std::array<glm::vec4, 6> planes;
+    auto rows = glm::transpose(matrix);
+    for(int i = 0; i < 3; ++i){
+      planes[2 * i] = rows[3] + rows[i];
+      planes[2 * i + 1] = rows[3] - rows[i];
+    }
+    auto visible = [&](const node& n){
+      auto radius = n.half * 1.7320508f;
+      for(auto& p:planes)
+        if(glm::dot(glm::vec3(p), n.center) + p.w < -radius * glm::length(glm::vec3(p)))
+          return false;
+      return true;
+    };
+    auto priority = [&](const node& n){
+      return n.half * 1.7320508f / std::max(glm::distance(eye, n.center), 1e-6f) * pixels_per_radian;
+    };
+    std::priority_queue<std::pair<float, int32_t>> queue;
+    queue.push({priority(nodes[0]), 0});
+    size_t drawn = 0;
+    while(!queue.empty()){
+      auto& n = nodes[queue.top().second];
+      auto size = queue.top().first;
+      queue.pop();
+      // nodes below a pixel add nothing visible
+      if(size < 1 || !visible(n))
+        continue;
+      if(drawn + n.count > budget)
+        break;
+      drawn += n.count;
+      firsts.push_back(n.first);
+      counts.push_back(n.count);
+      for(auto c:n.children)
+        if(c >= 0)
+          queue.push({priority(nodes[c]), c});
+    }
+  }
+
+  std::vector<node> nodes;
+  std::vector<P> points;
+  glm::vec3 lo{}, extent{1};
+
+private:
+  struct entry{
+    uint64_t code;
+    uint32_t index;
+    bool operator<(const entry& other) const{ return code < other.code; }
+  };
+  struct task{
+    size_t begin, end;
+    int depth;
+    glm::vec3 center;
+    float half;
+    int32_t parent;
+    int slot;
+  };
+  static uint64_t spread(uint64_t x){
+    x &= 0x1fffff;
+    x = (x | x << 32) & 0x1f00000000ffff;
+    x = (x | x << 16) & 0x1f0000ff0000ff;
+    x = (x | x << 8) & 0x100f00f00f00f00f;
+    x = (x | x << 4) & 0x10c30c30c30c30c3;
+    x = (x | x << 2) & 0x1249249249249249;
+    return x;
+  }
+  // position normalized to the root cube
+  static uint64_t morton(glm::vec3 p){
+    auto q = glm::clamp(p, glm::vec3(0), glm::vec3(1)) * float((1 << max_depth) - 1);
+    return spread(q.x) << 2 | spread(q.y) << 1 | spread(q.z);
+  }
+  static int octant(uint64_t code, int depth){
+    return code >> (3 * (max_depth - 1 - depth)) & 7;
+  }
+
+  // with tasks set, stops at depth 2 and leaves the subtrees to the caller
+  int32_t build(
+    std::vector<entry>& entries,
+    size_t begin,
+    size_t end,
+    int depth,
+    glm::vec3 center,
+    float half,
+    std::vector<node>& out,
+    std::vector<task>* tasks
+  ){
+    auto index = (int32_t)out.size();
+    auto& n = out.emplace_back(node{center, half, (uint32_t)begin, (uint32_t)(end - begin), {}});
+    n.children.fill(-1);
+    auto size = end - begin;
+    if(size <= capacity || depth == max_depth - 1)
+      return index;
+    // every stride-th point stays here, the rest stays in morton order
+    auto stride = (size + capacity - 1) / capacity;
+    auto first = entries.begin() + begin, last = entries.begin() + end;
+    std::vector<entry> ordered;
+    ordered.reserve(size);
+    for(size_t i = 0; i < size; i += stride)
+      ordered.push_back(first[i]);
+    auto kept = ordered.size();
+    for(size_t i = 0; i < size; ++i)
+      if(i % stride)
+        ordered.push_back(first[i]);
+    std::ranges::copy(ordered, first);
+    out[index].count = kept;
+    auto rest = first + kept;
+    for(int o = 0; o < 8; ++o){
+      auto child_end = std::partition_point(rest, last, [&](const entry& e){ return octant(e.code, depth) <= o; });
+      if(child_end != rest){
+        auto child_half = half / 2;
+        auto child_center = center + child_half * glm::vec3(
+          o & 4 ? 1 : -1,
+          o & 2 ? 1 : -1,
+          o & 1 ? 1 : -1
+        );
+        auto b = rest - entries.begin(), e = child_end - entries.begin();
+        if(tasks && depth + 1 == 2)
+          tasks->push_back({(size_t)b, (size_t)e, depth + 1, child_center, child_half, index, o});
+        else{
+          auto child = build(entries, b, e, depth + 1, child_center, child_half, out, tasks);
+          out[index].children[o] = child;
+        }
+      }
+      rest = child_end;
+    }
+    return index;
+  }
+};
+
+}
+}
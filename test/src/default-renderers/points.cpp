@@ -0,0 +1,193 @@
+#include "visualizer-plugin/visualizer-plugin.hpp"
+#include "visualizer-plugin/abstraction/gl.hpp"
+#include "default-renderers/points.hpp"
+#include "octree.hpp"
+#include "resources.hpp"
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <span>
+#include <vector>
+
+namespace plugin::impl {
+inline  namespace default_renderers {
+
+// points drawn per renderer and frame at most, VISUALIZER_POINT_BUDGET
+// overrides it
+inline size_t point_budget(){
+  static size_t budget = []{
+    auto env = std::getenv("VISUALIZER_POINT_BUDGET");
+    auto value = env ? std::strtoull(env, nullptr, 10) : 0;
+    return value ? value : 2'000'000ull;
+  }();
+  return budget;
+}
+
+template<class Point, bool has_color>
+struct point_cloud: renderer_base{
+  gl::program p = {
+    gl::shader<gl::shader_type::vertex>  {get_file("shaders/points.vert")},
+    gl::shader<gl::shader_type::fragment>{get_file("shaders/points.frag")}
+  };
+  octree<Point> tree;
+  gl::buffer<Point> points;
+  gl::vertex_array vao;
+  int mvp_loc = p.uniform_loc("mvp");
+  int has_color_loc = p.uniform_loc("has_color");
+  int lo_loc = p.uniform_loc("lo");
+  int extent_loc = p.uniform_loc("extent");
+  // written by update, drawn by the item submitted for the same view
+  std::vector<int> firsts, counts;
+  // the whole tree and its points once release_memory cut it, to be
+  // uploaded again by restore_memory
+  std::vector<typename octree<Point>::node> full_nodes;
+  std::vector<Point> spilled;
+
+  // snapshots keep the tree, lo and extent first, and the reordered points
+  struct bounds{
+    glm::vec3 lo, extent;
+  };
+
+  template<class S, class Position>
+  point_cloud(std::span<const S> source, Position&& position){
+    auto kept_tree = restored_blob(0), kept_points = restored_blob(1);
+    using node = typename octree<Point>::node;
+    if(kept_tree.size() >= sizeof(bounds) && !kept_points.empty()){
+      bounds b;
+      std::memcpy(&b, kept_tree.data(), sizeof b);
+      tree.lo = b.lo;
+      tree.extent = b.extent;
+      tree.nodes.resize((kept_tree.size() - sizeof b) / sizeof(node));
+      std::memcpy(tree.nodes.data(), kept_tree.data() + sizeof b, tree.nodes.size() * sizeof(node));
+    }
+    else{
+      tree = octree<Point>(source, position);
+      kept_points = std::as_bytes(std::span(tree.points));
+    }
+    auto count = kept_points.size() / sizeof(Point);
+    if(count)
+      points = gl::buffer<Point>(count, 0, (const Point*)kept_points.data());
+    vao = {p, points};
+    bounds b{tree.lo, tree.extent};
+    std::vector<std::byte> kept(sizeof b + tree.nodes.size() * sizeof(node));
+    std::memcpy(kept.data(), &b, sizeof b);
+    std::memcpy(kept.data() + sizeof b, tree.nodes.data(), tree.nodes.size() * sizeof(node));
+    keep_for_snapshot(kept);
+    keep_for_snapshot(kept_points);
+    // the gpu copy is all that is drawn from
+    tree.points = {};
+  }
+  bool is_transparent() const override {
+    return false;
+  }
+  void update(const renderer_context& c) override{
+    tree.select(
+      c.matrix(),
+      c.position(),
+      c.resolution().y / 2.f,
+      point_budget(),
+      firsts,
+      counts
+    );
+  }
+  // drops the finest levels of the tree until about bytes are free; what
+  // stays is copied into a smaller buffer on the gpu and the dropped nodes
+  // are cut off from their parents. the first cut reads all points back
+  // into host memory
+  void release_memory(size_t bytes) override{
+    auto& nodes = tree.nodes;
+    if(nodes.empty())
+      return;
+    if(spilled.empty()){
+      full_nodes = nodes;
+      spilled.resize(points.size());
+      glGetNamedBufferSubData(points.native(), 0, spilled.size() * sizeof(Point), spilled.data());
+    }
+    // children come after their parent
+    std::vector<int> depth(nodes.size(), -1);
+    depth[0] = 0;
+    for(size_t i = 0; i < nodes.size(); ++i)
+      if(depth[i] >= 0)
+        for(auto c:nodes[i].children)
+          if(c >= 0)
+            depth[c] = depth[i] + 1;
+    auto keep = std::ranges::max(depth);
+    for(size_t freed = 0; keep > 0 && freed < bytes; --keep)
+      for(size_t i = 0; i < nodes.size(); ++i)
+        if(depth[i] == keep)
+          freed += nodes[i].count * sizeof(Point);
+    size_t kept = 0;
+    for(size_t i = 0; i < nodes.size(); ++i)
+      if(depth[i] >= 0 && depth[i] <= keep)
+        kept += nodes[i].count;
+    if(kept == points.size())
+      return;
+    gl::buffer<Point> next(kept, 0);
+    uint32_t at = 0;
+    for(size_t i = 0; i < nodes.size(); ++i){
+      auto& n = nodes[i];
+      if(depth[i] < 0 || depth[i] > keep)
+        continue;
+      glCopyNamedBufferSubData(points.native(), next.native(), n.first * sizeof(Point), at * sizeof(Point), n.count * sizeof(Point));
+      n.first = at;
+      at += n.count;
+      if(depth[i] == keep)
+        n.children.fill(-1);
+    }
+    points = std::move(next);
+    vao = {p, points};
+  }
+  void restore_memory(size_t bytes) override{
+    if(spilled.empty() || (spilled.size() - points.size()) * sizeof(Point) > bytes)
+      return;
+    // the old buffer goes first so that both are never held at once
+    points = {};
+    points = gl::buffer<Point>(spilled.size(), 0, spilled.data());
+    vao = {p, points};
+    tree.nodes = std::move(full_nodes);
+    full_nodes = {};
+    spilled = {};
+  }
+  void submit(render_queue& q) override{
+    q.push({
+      .prepare = [](void* self, const renderer_context ctx){
+        auto& cloud = *static_cast<point_cloud*>(self);
+        if(cloud.firsts.empty())
+          return;
+        auto& state = gl::state::current();
+        state.use_program(cloud.p.native());
+        state.bind_vertex_array(cloud.vao.native());
+        glUniformMatrix4fv(cloud.mvp_loc, 1, false, &ctx.matrix()[0][0]);
+        glUniform1i(cloud.has_color_loc, has_color);
+        glUniform3fv(cloud.lo_loc, 1, &cloud.tree.lo[0]);
+        glUniform3fv(cloud.extent_loc, 1, &cloud.tree.extent[0]);
+        glMultiDrawArrays(GL_POINTS, cloud.firsts.data(), cloud.counts.data(), cloud.firsts.size());
+      },
+      .user = this
+    });
+  }
+};
+
+struct plain_point{
+  glm::vec3 pos;
+};
+
+}
+}
+
+template<>
+struct plugin::renderer<std::vector<glm::vec3>>::type:
+  plugin::impl::point_cloud<plugin::impl::plain_point, false>{
+  type(const std::vector<glm::vec3>& x):
+    point_cloud(std::span(x), [](glm::vec3 p){ return p; }){}
+};
+VISUALIZER_PLUGIN_RENDERER(std::vector<glm::vec3>);
+
+template<>
+struct plugin::renderer<std::vector<default_renderers::colored_point>>::type:
+  plugin::impl::point_cloud<default_renderers::colored_point, true>{
+  type(const std::vector<default_renderers::colored_point>& x):
+    point_cloud(std::span(x), [](const default_renderers::colored_point& p){ return p.pos; }){}
+};
+VISUALIZER_PLUGIN_RENDERER(std::vector<default_renderers::colored_point>);
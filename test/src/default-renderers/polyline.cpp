@@ -0,0 +1,250 @@
+#include "visualizer-plugin/visualizer-plugin.hpp"
+#include "visualizer-plugin/abstraction/gl.hpp"
+#include "resources.hpp"
+#include <glm/gtc/matrix_transform.hpp>
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <limits>
+#include <span>
+#include <stdexcept>
+#include <vector>
+
+namespace plugin::impl {
+inline  namespace default_renderers {
+
+// signals in the z = 0 plane with increasing x. a compute pass builds a
+// pyramid of per-bucket y ranges over buckets of 2, 4, 8... samples; each
+// frame draws the raw samples or the level whose buckets are about a pixel
+// wide, as a strip through the minimum and maximum of every bucket.
+// only y is uploaded when x is the sample index; the shaders derive it from
+// gl_VertexID relative to the first sample drawn, so it stays exact for any
+// number of samples the shaders' 32-bit ints index; longer signals are
+// rejected
+struct polyline: renderer_base{
+  // x of every mark_stride-th sample, to find the samples in view; empty
+  // when x is the index
+  static constexpr size_t mark_stride = 4096;
+
+  gl::program raw_p = {
+    gl::shader<gl::shader_type::vertex>  {get_file("shaders/lines.vert")},
+    gl::shader<gl::shader_type::fragment>{get_file("shaders/lines.frag")}
+  };
+  gl::program minmax_p = {
+    gl::shader<gl::shader_type::vertex>  {get_file("shaders/lines_minmax.vert")},
+    gl::shader<gl::shader_type::fragment>{get_file("shaders/lines.frag")}
+  };
+  gl::program pyramid_p = {
+    gl::shader<gl::shader_type::compute>{get_file("shaders/lines_pyramid.comp")}
+  };
+  size_t count;
+  gl::buffer<float> ys, xs;
+  // the shaders read the samples from storage buffers
+  gl::vertex_array vao{raw_p};
+  // the raw program has no pyramid, its locations of those are -1
+  struct uniforms{
+    uniforms(gl::program& p):
+      mvp(p.uniform_loc("mvp")),
+      color(p.uniform_loc("color")),
+      has_x(p.uniform_loc("has_x")),
+      base(p.uniform_loc("base")),
+      level_offset(p.uniform_loc("level_offset")),
+      bucket_size(p.uniform_loc("bucket_size")),
+      sample_count(p.uniform_loc("sample_count"))
+    {}
+    int mvp, color, has_x, base, level_offset, bucket_size, sample_count;
+  } raw_u{raw_p}, minmax_u{minmax_p};
+  std::vector<size_t> level_offsets;
+  gl::buffer<glm::vec2> pyramid;
+  std::vector<double> marks;
+  glm::vec2 y_range{};
+  // written by update, drawn by the item submitted for the same view
+  struct selection{
+    int level = -1;
+    size_t first = 0, count = 0;
+  } visible;
+
+  // y(i) for every sample, x(i) only for signals with an x of their own
+  template<class Y, class... X>
+  polyline(size_t n, Y&& y, X&&... x):
+    count(n)
+  {
+    if(n > (size_t)std::numeric_limits<int>::max())
+      throw std::length_error("signal longer than 2^31 - 1 samples");
+    // an empty immutable buffer is an error
+    if(!n)
+      return;
+    auto upload = [n](auto&& f){
+      gl::buffer<float> to(n, GL_DYNAMIC_STORAGE_BIT);
+      std::vector<float> chunk;
+      for(size_t begin = 0; begin < n; begin += 1 << 20){
+        chunk.clear();
+        for(size_t i = begin; i < std::min(n, begin + (1 << 20)); ++i)
+          chunk.push_back(f(i));
+        to.write(begin, chunk);
+      }
+      return to;
+    };
+    ys = upload(y);
+    ((xs = upload(x)), ...);
+    ([&]{
+      for(size_t i = 0; i < n; i += mark_stride)
+        marks.push_back(x(i));
+      marks.push_back(x(n - 1));
+    }(), ...);
+    build_pyramid();
+  }
+
+  void build_pyramid(){
+    size_t total = 0;
+    for(auto size = count; size > 1; size = (size + 1) / 2){
+      level_offsets.push_back(total);
+      total += (size + 1) / 2;
+    }
+    if(!total)
+      return;
+    pyramid = gl::buffer<glm::vec2>(total, 0);
+    ys.bind(gl::bind_point::shader_storage, 0);
+    pyramid.bind(gl::bind_point::shader_storage, 1);
+    pyramid_p.bind();
+    auto src_count = count;
+    for(size_t level = 0; level < level_offsets.size(); ++level){
+      auto dst_count = (src_count + 1) / 2;
+      glUniform1i(pyramid_p.uniform_loc("from_samples"), level == 0);
+      glUniform1i(pyramid_p.uniform_loc("src_offset"), level ? level_offsets[level - 1] : 0);
+      glUniform1i(pyramid_p.uniform_loc("src_count"), src_count);
+      glUniform1i(pyramid_p.uniform_loc("dst_offset"), level_offsets[level]);
+      glUniform1i(pyramid_p.uniform_loc("dst_count"), dst_count);
+      glDispatchCompute((dst_count + 255) / 256, 1, 1);
+      glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+      src_count = dst_count;
+    }
+    // the top of the pyramid is the range of the whole signal
+    glGetNamedBufferSubData(pyramid.native(), (total - 1) * sizeof(glm::vec2), sizeof(glm::vec2), &y_range);
+  }
+
+  // the part of [0, 1] along the signal that is inside the left, right and
+  // near planes, clip coordinates being linear along it
+  static std::pair<double, double> clip(glm::dvec4 a, glm::dvec4 b){
+    double lo = 0, hi = 1;
+    auto keep = [&](double fa, double fb){
+      if(fa < 0 && fb < 0)
+        hi = -1;
+      else if(fa < 0)
+        lo = std::max(lo, fa / (fa - fb));
+      else if(fb < 0)
+        hi = std::min(hi, fa / (fa - fb));
+    };
+    keep(a.w + a.x, b.w + b.x);
+    keep(a.w - a.x, b.w - b.x);
+    keep(a.w + a.z, b.w + b.z);
+    return {lo, hi};
+  }
+
+  // x of the first and last sample
+  double front() const{
+    return marks.empty() ? 0 : marks.front();
+  }
+  double back() const{
+    return marks.empty() ? count - 1 : marks.back();
+  }
+  size_t index_of(double x, bool upper) const{
+    if(marks.empty())
+      return upper
+        ? std::min<double>(count, std::max(0., std::floor(x) + 2))
+        : std::min<double>(count - 1, std::max(0., std::floor(x)));
+    auto it = std::ranges::lower_bound(marks, x);
+    auto mark = it - marks.begin();
+    if(upper)
+      return std::min(count, (size_t)mark * mark_stride + 1);
+    return mark ? (mark - 1) * mark_stride : 0;
+  }
+
+  bool is_transparent() const override {
+    return false;
+  }
+  void update(const renderer_context& c) override{
+    visible = {};
+    if(count < 2)
+      return;
+    double y = (y_range.x + y_range.y) / 2;
+    glm::dmat4 m(c.matrix());
+    glm::dvec4 a = m * glm::dvec4(front(), y, 0, 1);
+    glm::dvec4 b = m * glm::dvec4(back(), y, 0, 1);
+    auto [t0, t1] = clip(a, b);
+    if(t0 >= t1)
+      return;
+    auto at = [&](double t){ return a + t * (b - a); };
+    auto pa = at(t0), pb = at(t1);
+    auto pixels = glm::length(
+      (glm::dvec2(pb) / pb.w - glm::dvec2(pa) / pa.w) * glm::dvec2(c.resolution()) / 2.
+    );
+    auto x0 = front() + t0 * (back() - front());
+    auto x1 = front() + t1 * (back() - front());
+    auto first = index_of(x0, false), last = index_of(x1, true);
+    auto per_pixel = (last - first) / std::max(pixels, 1.);
+    if(per_pixel <= 1){
+      visible = {-1, first, last - first};
+      return;
+    }
+    auto level = std::min<size_t>(std::ceil(std::log2(per_pixel)), level_offsets.size());
+    auto bucket = size_t(1) << level;
+    visible = {(int)level - 1, first / bucket, (last + bucket - 1) / bucket - first / bucket};
+  }
+  void submit(render_queue& q) override{
+    q.push({
+      .prepare = [](void* self, const renderer_context ctx){
+        auto& line = *static_cast<polyline*>(self);
+        auto v = line.visible;
+        if(!v.count)
+          return;
+        auto& state = gl::state::current();
+        auto& p = v.level < 0 ? line.raw_p : line.minmax_p;
+        auto& u = v.level < 0 ? line.raw_u : line.minmax_u;
+        state.use_program(p.native());
+        // an index x is drawn relative to the first sample, the matrix is
+        // moved there in double precision
+        auto base = v.level < 0 ? v.first : v.first << (v.level + 1);
+        glm::dmat4 m(ctx.matrix());
+        if(!line.xs)
+          m = glm::translate(m, glm::dvec3(base, 0, 0));
+        glm::mat4 mvp(m);
+        glUniformMatrix4fv(u.mvp, 1, false, &mvp[0][0]);
+        glUniform3f(u.color, 0.9f, 0.6f, 0.1f);
+        glUniform1i(u.has_x, (bool)line.xs);
+        glUniform1i(u.base, base);
+        state.bind_vertex_array(line.vao.native());
+        line.ys.bind(gl::bind_point::shader_storage, 0);
+        (line.xs ? line.xs : line.ys).bind(gl::bind_point::shader_storage, 2);
+        if(v.level < 0){
+          glDrawArrays(GL_LINE_STRIP, v.first, v.count);
+          return;
+        }
+        line.pyramid.bind(gl::bind_point::shader_storage, 1);
+        glUniform1i(u.level_offset, line.level_offsets[v.level]);
+        glUniform1i(u.bucket_size, 2 << v.level);
+        glUniform1i(u.sample_count, line.count);
+        // gl_VertexID starts at first, the shader derives the bucket from it
+        glDrawArrays(GL_LINE_STRIP, 2 * v.first, 2 * v.count);
+      },
+      .user = this
+    });
+  }
+};
+
+}
+}
+
+template<>
+struct plugin::renderer<std::vector<float>>::type: plugin::impl::polyline{
+  type(const std::vector<float>& x):
+    polyline(x.size(), [&](size_t i){ return x[i]; }){}
+};
+VISUALIZER_PLUGIN_RENDERER(std::vector<float>);
+
+template<>
+struct plugin::renderer<std::vector<glm::vec2>>::type: plugin::impl::polyline{
+  type(const std::vector<glm::vec2>& x):
+    polyline(x.size(), [&](size_t i){ return x[i].y; }, [&](size_t i){ return x[i].x; }){}
+};
+VISUALIZER_PLUGIN_RENDERER(std::vector<glm::vec2>);
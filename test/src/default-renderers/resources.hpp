@@ -0,0 +1,17 @@
+#pragma once
+#include <cmrc/cmrc.hpp>
+#include <string_view>
+
+CMRC_DECLARE(default_renderers);
+
+namespace plugin::impl {
+inline  namespace default_renderers {
+
+inline std::string_view get_file(const char *path) {
+  auto fs = cmrc::default_renderers::get_filesystem();
+  auto file = fs.open(path);
+  return {file.begin(), file.end()};
+}
+
+}
+}
@@ -1,14 +1,14 @@
-#include <dlfcn.h>
-
 //
 // Created by user on 11/13/23.
 //
+#include <unistd.h>
+#include "visualizer-plugin/visualizer-plugin.hpp"
 
-namespace plugin {
-extern void open(const char *, unsigned);
-}
+// nothing links the default renderers: the cube's type is found in the
+// libraries of the build directory, which is loaded on the first value
 int main(){
-  int c = 0;
+  plugin::add_plugin_directory(PLUGIN_DIRECTORY);
   plugin::open("127.0.0.1", 7576);
-  for(;;) ++c;
-}
\ No newline at end of file
+  plugin::renderer<int>::add(0);
+  for(;;) pause();
+}
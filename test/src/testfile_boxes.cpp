@@ -0,0 +1,22 @@
+#include <cstdlib>
+#include <unistd.h>
+#include <vector>
+#include "visualizer-plugin/visualizer-plugin.hpp"
+#include "default-renderers/boxes.hpp"
+
+// a grid of boxes drawn as gpu objects, culled against the view and the
+// depth of the previous frame.
+// usage: testfile_boxes [boxes per side]
+int main(int argc, char** argv){
+  int side = argc > 1 ? std::atoi(argv[1]) : 64;
+  std::vector<default_renderers::box> boxes;
+  for(int z = 0; z < side; ++z)
+    for(int y = 0; y < side; ++y)
+      for(int x = 0; x < side; ++x){
+        glm::vec3 lo(x * 3 - side * 1.5f, y * 3 - side * 1.5f, z * 3 - side * 1.5f);
+        boxes.push_back({lo, lo + glm::vec3(2)});
+      }
+  plugin::renderer<std::vector<default_renderers::box>>::add(std::move(boxes));
+  plugin::open("127.0.0.1", 7576);
+  for(;;) pause();
+}
@@ -0,0 +1,19 @@
+#include <cstdlib>
+#include <unistd.h>
+#include "visualizer-plugin/visualizer-plugin.hpp"
+
+// a compositor and several worker processes on loopback; only the first
+// worker owns the cube and draws the ground plane.
+// usage: testfile_composite [workers]
+int main(int argc, char** argv){
+  unsigned workers = argc > 1 ? std::atoi(argv[1]) : 2;
+  for(unsigned i = 0; i < workers; ++i)
+    if(fork() == 0){
+      plugin::open_worker("127.0.0.1", 7577);
+      if(i == 0)
+        plugin::renderer<int>::add(0);
+      for(;;) pause();
+    }
+  plugin::composite("127.0.0.1", 7576, 7577, workers);
+  for(;;) pause();
+}